@@ -0,0 +1,160 @@
+#include "common.hpp"
+#include "arena.hpp"
+
+static const size_t kArenaBlockSize = 256 * 1024;
+static const size_t kArenaMinTailSize = 4 * 1024;
+
+static thread_local ArenaScope* gArenaScope;
+
+static char* alignPointer(char* ptr, size_t align)
+{
+	return reinterpret_cast<char*>((uintptr_t(ptr) + align - 1) & ~uintptr_t(align - 1));
+}
+
+Arena::Arena(): blocks(nullptr)
+{
+}
+
+Arena::~Arena()
+{
+	for (size_t i = finalizers.size(); i > 0; --i)
+		finalizers[i - 1]();
+
+	while (blocks)
+	{
+		Block* next = blocks->next;
+
+		::operator delete(blocks);
+
+		blocks = next;
+	}
+}
+
+char* Arena::allocateBlock(size_t size)
+{
+	Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+
+	{
+		lock_guard<mutex> l(lock);
+
+		block->next = blocks;
+		blocks = block;
+	}
+
+	return reinterpret_cast<char*>(block + 1);
+}
+
+void Arena::addTail(char* begin, char* end)
+{
+	if (!begin || size_t(end - begin) < kArenaMinTailSize)
+		return;
+
+	lock_guard<mutex> l(lock);
+
+	tails.push_back(make_pair(begin, end));
+}
+
+bool Arena::takeTail(size_t size, char*& begin, char*& end)
+{
+	lock_guard<mutex> l(lock);
+
+	for (size_t i = tails.size(); i > 0; --i)
+		if (size_t(tails[i - 1].second - tails[i - 1].first) >= size)
+		{
+			begin = tails[i - 1].first;
+			end = tails[i - 1].second;
+
+			tails.erase(tails.begin() + (i - 1));
+
+			return true;
+		}
+
+	return false;
+}
+
+void Arena::addFinalizer(function<void ()> callback)
+{
+	lock_guard<mutex> l(lock);
+
+	finalizers.push_back(move(callback));
+}
+
+ArenaScope::ArenaScope(Arena* arena): arena(arena), previous(gArenaScope), current(nullptr), end(nullptr)
+{
+	if (previous && previous->arena == arena)
+	{
+		current = previous->current;
+		end = previous->end;
+	}
+
+	gArenaScope = this;
+}
+
+ArenaScope::~ArenaScope()
+{
+	assert(gArenaScope == this);
+
+	if (previous && previous->arena == arena)
+	{
+		previous->current = current;
+		previous->end = end;
+	}
+	else if (arena)
+	{
+		arena->addTail(current, end);
+	}
+
+	gArenaScope = previous;
+}
+
+Arena* arenaGetCurrent()
+{
+	return gArenaScope ? gArenaScope->arena : nullptr;
+}
+
+void* arenaAllocate(size_t size, size_t align)
+{
+	ArenaScope* scope = gArenaScope;
+
+	if (!scope || !scope->arena)
+		return ::operator new(size);
+
+	assert((align & (align - 1)) == 0);
+
+	char* result = alignPointer(scope->current, align);
+
+	if (!scope->current || result + size > scope->end)
+	{
+		// large allocations get a separate block so that the rest of the current block isn't wasted
+		if (size + align > kArenaBlockSize / 4)
+			return alignPointer(scope->arena->allocateBlock(size + align), align);
+
+		scope->arena->addTail(scope->current, scope->end);
+
+		if (!scope->arena->takeTail(size + align, scope->current, scope->end))
+		{
+			scope->current = scope->arena->allocateBlock(kArenaBlockSize);
+			scope->end = scope->current + kArenaBlockSize;
+		}
+
+		result = alignPointer(scope->current, align);
+	}
+
+	scope->current = result + size;
+
+	return result;
+}
+
+bool arenaExtend(void* data, size_t size, size_t newSize)
+{
+	ArenaScope* scope = gArenaScope;
+
+	char* ptr = static_cast<char*>(data);
+
+	if (!scope || !scope->arena || !ptr || scope->current != ptr + size || ptr + newSize > scope->end)
+		return false;
+
+	scope->current = ptr + newSize;
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+
+// Compilation-scoped bump allocator for AST nodes, types, variables and array storage
+// Objects are never destroyed individually; all memory is released at once when the arena is destroyed
+struct Arena
+{
+	struct Block
+	{
+		Block* next;
+	};
+
+	mutex lock;
+	Block* blocks;
+
+	// unused ends of blocks left by closed scopes; new scopes continue in them before allocating more blocks
+	vector<pair<char*, char*>> tails;
+
+	// called in reverse order of registration before the memory is released
+	vector<function<void ()>> finalizers;
+
+	Arena();
+	~Arena();
+
+	char* allocateBlock(size_t size);
+
+	void addTail(char* begin, char* end);
+	bool takeTail(size_t size, char*& begin, char*& end);
+
+	void addFinalizer(function<void ()> callback);
+};
+
+// Makes the arena active on the calling thread; every thread that allocates from the arena needs its own scope
+// Nested scopes of the same arena continue in the block of the outer scope and give it back when they close
+struct ArenaScope
+{
+	Arena* arena;
+	ArenaScope* previous;
+
+	char* current;
+	char* end;
+
+	explicit ArenaScope(Arena* arena);
+	~ArenaScope();
+};
+
+Arena* arenaGetCurrent();
+
+// Allocations outside of an arena scope go to the global heap and are never freed
+void* arenaAllocate(size_t size, size_t align);
+
+// Grows the last allocation made on the calling thread in place; returns false if it's not possible
+bool arenaExtend(void* data, size_t size, size_t newSize);
+
+#define ARENA_NEW(type) new (arenaAllocate(sizeof(type), alignof(type))) type
\ No newline at end of file
@@ -13,10 +13,18 @@ template <typename T> struct Arr
 	template <typename It> Arr(It begin, It end): data(0), size(0), capacity(0)
 	{
 		capacity = end - begin;
-		data = new T[capacity];
+		data = static_cast<T*>(arenaAllocate(capacity * sizeof(T), alignof(T)));
 
 		for (It it = begin; it != end; ++it)
-			data[size++] = *it;
+			new (&data[size++]) T(*it);
+	}
+
+	explicit Arr(size_t count): data(0), size(count), capacity(count)
+	{
+		data = static_cast<T*>(arenaAllocate(capacity * sizeof(T), alignof(T)));
+
+		for (size_t i = 0; i < size; ++i)
+			new (&data[i]) T();
 	}
 
 	Arr(initializer_list<T> list): Arr(list.begin(), list.end())
@@ -60,15 +68,22 @@ template <typename T> struct Arr
 		if (size == capacity)
 		{
 			size_t new_capacity = capacity + capacity / 2 + 1;
-			T* new_data = new T[new_capacity];
 
-			for (size_t i = 0; i < capacity; ++i)
-				new_data[i] = data[i];
+			// the array is often the last allocation in the arena, in which case it can grow in place;
+			// otherwise the old storage is abandoned and reclaimed together with the arena
+			if (!arenaExtend(data, capacity * sizeof(T), new_capacity * sizeof(T)))
+			{
+				T* new_data = static_cast<T*>(arenaAllocate(new_capacity * sizeof(T), alignof(T)));
+
+				for (size_t i = 0; i < size; ++i)
+					new (&new_data[i]) T(data[i]);
+
+				data = new_data;
+			}
 
-			data = new_data;
 			capacity = new_capacity;
 		}
 
-		data[size++] = item;
+		new (&data[size++]) T(item);
 	}
 };
\ No newline at end of file
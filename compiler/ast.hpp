@@ -64,6 +64,20 @@ struct FieldRef
 	int index;
 };
 
+struct Tokens;
+
+// Token range of a function body that hasn't been parsed yet
+// Bodies loaded from interface files share an empty token array that is filled from the source on first use
+struct LazyBody
+{
+	Tokens* tokens;
+
+	size_t begin;
+	size_t end;
+
+	Location indent;
+};
+
 #define UD_AST(X) \
 	X(Common, { Ty* type; Location location; }) \
 	X(LiteralVoid, { Ty* type; Location location; }) \
@@ -88,7 +102,7 @@ struct FieldRef
 	X(While, { Ty* type; Location location; Ast* expr; Ast* body; }) \
 	X(Fn, { Ty* type; Location location; int id; Ast* decl; }) \
 	X(LLVM, { Ty* type; Location location; Str code; }) \
-	X(FnDecl, { Ty* type; Location location; Variable* var; Arr<Ty*> tyargs; Arr<Variable*> args; unsigned attributes; Ast* body; Ast::FnDecl* parent; Ast::Module* module; }) \
+	X(FnDecl, { Ty* type; Location location; Variable* var; Arr<Ty*> tyargs; Arr<Variable*> args; unsigned attributes; Ast* body; Ast::FnDecl* parent; Ast::Module* module; LazyBody* lazy; }) \
 	X(VarDecl, { Ty* type; Location location; Variable* var; Ast* expr; }) \
 	X(TyDecl, { Ty* type; Location location; Str name; TyDef* def; }) \
 	X(Import, { Ty* type; Location location; Str name; })
@@ -0,0 +1,122 @@
+#include "common.hpp"
+#include "cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 64-bit FNV-1a
+CacheHash::CacheHash(): value(14695981039346656037ull)
+{
+}
+
+void CacheHash::update(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		value ^= bytes[i];
+		value *= 1099511628211ull;
+	}
+}
+
+void CacheHash::update(const string& data)
+{
+	update(static_cast<long long>(data.size()));
+	update(data.data(), data.size());
+}
+
+void CacheHash::update(const Str& data)
+{
+	update(static_cast<long long>(data.size));
+	update(data.data, data.size);
+}
+
+void CacheHash::update(long long data)
+{
+	update(&data, sizeof(data));
+}
+
+string CacheHash::str() const
+{
+	char result[17];
+	snprintf(result, sizeof(result), "%016llx", value);
+
+	return result;
+}
+
+string cacheGetDefaultPath()
+{
+	if (const char* path = getenv("AIKE_CACHE_DIR"))
+		return path;
+
+	if (const char* home = getenv("HOME"))
+		return string(home) + "/.cache/aike";
+
+	return "";
+}
+
+string cacheGetCompilerVersion(const string& compilerPath)
+{
+	// There is no version number that changes with every compiler build, so we identify the compiler binary itself
+	struct stat st;
+	if (stat(compilerPath.c_str(), &st) != 0)
+		return "";
+
+	CacheHash hash;
+	hash.update(static_cast<long long>(st.st_size));
+	hash.update(static_cast<long long>(st.st_mtime));
+
+	return hash.str();
+}
+
+static void cacheCreateFolder(const string& path)
+{
+	for (size_t slash = path.find('/', 1); slash != string::npos; slash = path.find('/', slash + 1))
+		mkdir(path.substr(0, slash).c_str(), 0755);
+
+	mkdir(path.c_str(), 0755);
+}
+
+bool cacheLoad(const string& path, const string& key, string& data)
+{
+	ifstream in(path + "/" + key + ".o", ios::in | ios::binary);
+	if (!in)
+		return false;
+
+	ostringstream ss;
+	ss << in.rdbuf();
+
+	if (!ss)
+		return false;
+
+	data = ss.str();
+	return true;
+}
+
+void cacheStore(const string& path, const string& key, const string& data)
+{
+	cacheCreateFolder(path);
+
+	// Several compiler processes may populate the cache concurrently; rename makes sure readers never see partial files
+	ostringstream temp;
+	temp << path << "/" << key << ".tmp" << getpid() << "-" << this_thread::get_id();
+
+	{
+		ofstream of(temp.str(), ios::out | ios::binary);
+		of.write(data.c_str(), data.size());
+
+		if (!of)
+		{
+			unlink(temp.str().c_str());
+			return;
+		}
+	}
+
+	if (rename(temp.str().c_str(), (path + "/" + key + ".o").c_str()) != 0)
+		unlink(temp.str().c_str());
+}
\ No newline at end of file
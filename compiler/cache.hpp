@@ -0,0 +1,21 @@
+#pragma once
+
+struct CacheHash
+{
+	unsigned long long value;
+
+	CacheHash();
+
+	void update(const void* data, size_t size);
+	void update(const string& data);
+	void update(const Str& data);
+	void update(long long data);
+
+	string str() const;
+};
+
+string cacheGetDefaultPath();
+string cacheGetCompilerVersion(const string& compilerPath);
+
+bool cacheLoad(const string& path, const string& key, string& data);
+void cacheStore(const string& path, const string& key, const string& data);
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "visit.hpp"
 #include "output.hpp"
 #include "mangle.hpp"
+#include "source.hpp"
+#include "timer.hpp"
 
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/DIBuilder.h"
@@ -12,6 +14,8 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Intrinsics.h"
 
+#include "llvm/ADT/Triple.h"
+
 #include "llvm/AsmParser/Parser.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
@@ -46,6 +50,7 @@ struct Codegen
 
 	Constant* runtimeNew;
 	Constant* runtimeNewArray;
+	Constant* runtimeRoot;
 
 	unordered_map<Variable*, Value*> vars;
 
@@ -53,6 +58,14 @@ struct Codegen
 	FunctionInstance* currentFunction;
 
 	vector<DIScope*> debugBlocks;
+
+	bool comdats;
+
+	// lowered types are keyed by the canonical ground type, so each type is lowered once per module in any generic context
+	unordered_map<Ty*, Type*> types;
+	unordered_map<Ty*, Constant*> typeInfos;
+	unordered_map<Ty*, DIType*> typeDebugs;
+	unordered_map<Ty*, string> typeNames;
 };
 
 enum CodegenKind
@@ -69,7 +82,11 @@ struct CodegenDebugLocation
 	CodegenDebugLocation(Codegen& cg, const Location& location): cg(cg), debugLoc(cg.ir->getCurrentDebugLocation())
 	{
 		if (cg.di)
-			cg.ir->SetCurrentDebugLocation(DebugLoc::get(location.line + 1, location.column + 1, cg.debugBlocks.back()));
+		{
+			SourcePosition pos = sourceResolve(location);
+
+			cg.ir->SetCurrentDebugLocation(DebugLoc::get(pos.line + 1, pos.column + 1, cg.debugBlocks.back()));
+		}
 	}
 
 	~CodegenDebugLocation()
@@ -122,7 +139,56 @@ static Ty* tryGetGenericInstance(Codegen& cg, Ty* type)
 	return nullptr;
 }
 
-static Type* codegenType(Codegen& cg, Ty* type)
+static Ty* finalType(Codegen& cg, Ty* type)
+{
+	return typeInstantiate(type, [&](Ty* ty) -> Ty* {
+		return getGenericInstance(cg, ty);
+	});
+}
+
+static Ty* finalType(Codegen& cg, Ast* node)
+{
+	return finalType(cg, astType(node));
+}
+
+// Returns the canonical ground type used as a cache key, or nullptr if the type can't be made canonical
+static Ty* getTypeKey(Codegen& cg, Ty* type)
+{
+	Ty* result = typeCanonical(finalType(cg, type));
+
+	return (result->flags & TyFlagCanonical) ? result : nullptr;
+}
+
+template <typename T, typename F> static T getTypeCached(Codegen& cg, unordered_map<Ty*, T>& cache, Ty* type, F lower)
+{
+	Ty* key = getTypeKey(cg, type);
+
+	if (!key)
+		return lower(type);
+
+	auto it = cache.find(key);
+
+	if (it != cache.end())
+		return it->second;
+
+	// lowering may recurse into the same type, so the iterator can't be reused
+	T result = lower(key);
+
+	cache[key] = result;
+
+	return result;
+}
+
+static string getTypeName(Codegen& cg, Ty* type)
+{
+	return getTypeCached(cg, cg.typeNames, type, [&](Ty* key) {
+		return mangleType(key, [&](Ty* ty) { return getGenericInstance(cg, ty); });
+	});
+}
+
+static Type* codegenType(Codegen& cg, Ty* type);
+
+static Type* codegenTypeImpl(Codegen& cg, Ty* type)
 {
 	if (Ty* inst = tryGetGenericInstance(cg, type))
 		return codegenType(cg, inst);
@@ -197,7 +263,7 @@ static Type* codegenType(Codegen& cg, Ty* type)
 
 		if (UNION_CASE(Struct, d, t->def))
 		{
-			string name = mangleType(type, [&](Ty* ty) { return getGenericInstance(cg, ty); });
+			string name = getTypeName(cg, type);
 
 			if (StructType* st = cg.module->getTypeByName(name))
 				return st;
@@ -219,9 +285,26 @@ static Type* codegenType(Codegen& cg, Ty* type)
 	ICE("Unknown Ty kind %d", type->kind);
 }
 
+static Type* codegenType(Codegen& cg, Ty* type)
+{
+	return getTypeCached(cg, cg.types, type, [&](Ty* ty) { return codegenTypeImpl(cg, ty); });
+}
+
+// Every Aike module is emitted into its own LLVM module, and each of them gets a copy of all functions
+// and type infos it references (including generic instantiations); the linker keeps one of each.
+static void codegenLinkOnce(Codegen& cg, GlobalObject* value)
+{
+	value->setLinkage(GlobalValue::LinkOnceODRLinkage);
+
+	if (cg.comdats)
+		value->setComdat(cg.module->getOrInsertComdat(value->getName()));
+}
+
 static GlobalVariable* codegenPrepareTypeInfo(Codegen& cg, const string& name, Type* dataType)
 {
-	GlobalVariable* gv = new GlobalVariable(*cg.module, dataType, /* isConstant= */ true, GlobalValue::PrivateLinkage, nullptr, name);
+	GlobalVariable* gv = new GlobalVariable(*cg.module, dataType, /* isConstant= */ true, GlobalValue::LinkOnceODRLinkage, nullptr, name);
+
+	codegenLinkOnce(cg, gv);
 
 	gv->setUnnamedAddr(true);
 
@@ -237,7 +320,9 @@ static Constant* codegenMakeTypeInfo(Codegen& cg, const string& name, Constant*
 	return ConstantExpr::getPointerCast(gv, Type::getInt8PtrTy(*cg.context));
 }
 
-static Constant* codegenTypeInfo(Codegen& cg, Ty* type)
+static Constant* codegenTypeInfo(Codegen& cg, Ty* type);
+
+static Constant* codegenTypeInfoImpl(Codegen& cg, Ty* type)
 {
 	if (Ty* inst = tryGetGenericInstance(cg, type))
 		return codegenTypeInfo(cg, inst);
@@ -343,7 +428,14 @@ static Constant* codegenTypeInfo(Codegen& cg, Ty* type)
 	ICE("Unknown Ty kind %d", type->kind);
 }
 
-static DIType* codegenTypeDebug(Codegen& cg, Ty* type)
+static Constant* codegenTypeInfo(Codegen& cg, Ty* type)
+{
+	return getTypeCached(cg, cg.typeInfos, type, [&](Ty* ty) { return codegenTypeInfoImpl(cg, ty); });
+}
+
+static DIType* codegenTypeDebug(Codegen& cg, Ty* type);
+
+static DIType* codegenTypeDebugImpl(Codegen& cg, Ty* type)
 {
 	assert(cg.di);
 
@@ -458,7 +550,7 @@ static DIType* codegenTypeDebug(Codegen& cg, Ty* type)
 
 		if (UNION_CASE(Struct, d, t->def))
 		{
-			string name = "dbg." + mangleType(type, [&](Ty* ty) { return getGenericInstance(cg, ty); });
+			string name = "dbg." + getTypeName(cg, type);
 			NamedMDNode* node = cg.module->getOrInsertNamedMetadata(name);
 
 			if (node->getNumOperands())
@@ -497,16 +589,9 @@ static DIType* codegenTypeDebug(Codegen& cg, Ty* type)
 	ICE("Unknown Ty kind %d", type->kind);
 }
 
-static Ty* finalType(Codegen& cg, Ty* type)
-{
-	return typeInstantiate(type, [&](Ty* ty) -> Ty* {
-		return getGenericInstance(cg, ty);
-	});
-}
-
-static Ty* finalType(Codegen& cg, Ast* node)
+static DIType* codegenTypeDebug(Codegen& cg, Ty* type)
 {
-	return finalType(cg, astType(node));
+	return getTypeCached(cg, cg.typeDebugs, type, [&](Ty* ty) { return codegenTypeDebugImpl(cg, ty); });
 }
 
 static Value* codegenVoid(Codegen& cg)
@@ -521,6 +606,20 @@ static void codegenVariable(Codegen& cg, Variable* var, Value* value)
 	value->setName(var->name.str());
 }
 
+// Top-level variables of REPL entries are stored in globals so that later entries, which are separate modules, can refer to them
+static GlobalVariable* codegenGlobal(Codegen& cg, Variable* var, bool define)
+{
+	Type* type = codegenType(cg, var->type);
+	string name = var->name.str() + "." + to_string(var->location.offset);
+
+	GlobalVariable* gv = new GlobalVariable(*cg.module, type, /* isConstant= */ false, GlobalValue::ExternalLinkage,
+		define ? Constant::getNullValue(type) : nullptr, name);
+
+	cg.vars[var] = gv;
+
+	return gv;
+}
+
 static Value* codegenAlloca(Codegen& cg, Type* type, Constant* arraySize = nullptr)
 {
 	// LLVM has an undocumented convention related to alloca: alloca with
@@ -739,7 +838,9 @@ static Value* codegenFunctionDecl(Codegen& cg, Ast::FnDecl* decl, int id, Ty* ty
 		return fun;
 
 	FunctionType* funty = cast<FunctionType>(cast<PointerType>(codegenType(cg, type))->getElementType());
-	Function* fun = Function::Create(funty, GlobalValue::InternalLinkage, name, cg.module);
+	Function* fun = Function::Create(funty, GlobalValue::LinkOnceODRLinkage, name, cg.module);
+
+	codegenLinkOnce(cg, fun);
 
 	vector<pair<Ty*, Ty*>> inst;
 	assert(tyargs.size == decl->tyargs.size);
@@ -773,6 +874,14 @@ static Value* codegenIdent(Codegen& cg, Ast::Ident* n, CodegenKind kind)
 	else if (target->kind == Variable::KindVariable)
 	{
 		auto it = cg.vars.find(target);
+
+		// top-level variables of earlier REPL entries are defined in other modules
+		if (it == cg.vars.end() && cg.options.globals)
+		{
+			codegenGlobal(cg, target, /* define= */ false);
+			it = cg.vars.find(target);
+		}
+
 		assert(it != cg.vars.end());
 
 		if (kind != KindRef)
@@ -819,6 +928,23 @@ static Value* codegenBlock(Codegen& cg, Ast::Block* n, CodegenKind kind)
 
 static Value* codegenModule(Codegen& cg, Ast::Module* n, CodegenKind kind)
 {
+	if (cg.options.globals)
+	{
+		UNION_CASE(Block, b, n->body);
+		assert(b);
+
+		for (auto& c: b->body)
+			if (UNION_CASE(VarDecl, v, c))
+			{
+				GlobalVariable* gv = codegenGlobal(cg, v->var, /* define= */ true);
+
+				// JIT-compiled globals aren't scanned by the collector unless they are registered as roots
+				// TODO: refactor + fix int32/size_t
+				Value* size = cg.ir->CreateIntCast(ConstantExpr::getSizeOf(gv->getValueType()), cg.ir->getInt32Ty(), false);
+				cg.ir->CreateCall(cg.runtimeRoot, { cg.ir->CreateBitCast(gv, cg.ir->getInt8PtrTy()), size });
+			}
+	}
+
 	return codegenExpr(cg, n->body);
 }
 
@@ -1159,6 +1285,16 @@ static Value* codegenVarDecl(Codegen& cg, Ast::VarDecl* n, CodegenKind kind)
 
 	Value* expr = codegenExpr(cg, n->expr);
 
+	auto it = cg.vars.find(n->var);
+
+	// top-level variables of REPL entries are bound to globals by codegenModule
+	if (it != cg.vars.end() && isa<GlobalVariable>(it->second))
+	{
+		cg.ir->CreateStore(expr, it->second);
+
+		return codegenVoid(cg);
+	}
+
 	Value* storage = codegenAlloca(cg, expr->getType());
 	storage->setName(n->var->name.str());
 
@@ -1168,14 +1304,16 @@ static Value* codegenVarDecl(Codegen& cg, Ast::VarDecl* n, CodegenKind kind)
 
 	if (cg.di && cg.options.debugInfo >= 2)
 	{
-		DIFile* file = cg.di->createFile(n->var->location.source, StringRef());
+		SourcePosition pos = sourceResolve(n->var->location);
+
+		DIFile* file = cg.di->createFile(pos.source, StringRef());
 
 		DIType* dty = codegenTypeDebug(cg, n->var->type);
 		DILocalVariable* dvar = cg.di->createAutoVariable(
-			cg.debugBlocks.back(), n->var->name.str(), file, n->var->location.line + 1, dty,
+			cg.debugBlocks.back(), n->var->name.str(), file, pos.line + 1, dty,
 			/* alwaysPreserve= */ false, /* flags= */ 0);
 
-		DebugLoc dloc = DebugLoc::get(n->var->location.line + 1, n->var->location.column + 1, cg.debugBlocks.back());
+		DebugLoc dloc = DebugLoc::get(pos.line + 1, pos.column + 1, cg.debugBlocks.back());
 
 		cg.di->insertDeclare(storage, dvar, cg.di->createExpression(), dloc, cg.ir->GetInsertBlock());
 	}
@@ -1363,12 +1501,6 @@ static void codegenFunctionLLVM(Codegen& cg, const FunctionInstance& inst)
 			location.offset += 1; // skip quote
 			location.offset += offset - prefixLength;
 			location.length -= offset - prefixLength;
-
-			assert(err.getLineNo() >= 2);
-			location.line += err.getLineNo() - 2;
-
-			if (err.getLineNo() > 2)
-				location.column = err.getColumnNo() - 1;
 		}
 
 		cg.output->error(location, "Error parsing LLVM: %s", err.getMessage().str().c_str());
@@ -1412,19 +1544,21 @@ static void codegenFunctionBody(Codegen& cg, const FunctionInstance& inst)
 
 	if (cg.di && cg.options.debugInfo >= 2)
 	{
-		DIFile* file = cg.di->createFile(inst.decl->var->location.source, StringRef());
+		DIFile* file = cg.di->createFile(sourceResolve(inst.decl->var->location).source, StringRef());
 
 		for (size_t i = 0; i < inst.decl->args.size; ++i)
 		{
 			Variable* var = inst.decl->args[i];
 			Value* storage = args[i];
 
+			SourcePosition pos = sourceResolve(var->location);
+
 			DIType* dty = codegenTypeDebug(cg, var->type);
 			DILocalVariable* dvar = cg.di->createParameterVariable(
-				cg.debugBlocks.back(), var->name.str(), i + 1, file, var->location.line + 1, dty,
+				cg.debugBlocks.back(), var->name.str(), i + 1, file, pos.line + 1, dty,
 				/* alwaysPreserve= */ false, /* flags= */ 0);
 
-			DebugLoc dloc = DebugLoc::get(var->location.line + 1, var->location.column + 1, cg.debugBlocks.back());
+			DebugLoc dloc = DebugLoc::get(pos.line + 1, pos.column + 1, cg.debugBlocks.back());
 
 			cg.di->insertDeclare(storage, dvar, cg.di->createExpression(), dloc, cg.ir->GetInsertBlock());
 		}
@@ -1465,9 +1599,14 @@ static void codegenFunction(Codegen& cg, const FunctionInstance& inst)
 {
 	assert(inst.value->empty());
 
+	if (inst.decl->lazy && !cg.options.loadBody(inst.decl->var->fn))
+		return;
+
+	TraceScope trace("codegenFunction", Str(inst.value->getName().data(), inst.value->getName().size()));
+
 	if (cg.di)
 	{
-		const Location& loc = inst.decl->var->location;
+		SourcePosition loc = sourceResolve(inst.decl->var->location);
 
 		DIFile* file = cg.di->createFile(loc.source, StringRef());
 
@@ -1496,11 +1635,20 @@ static void codegenFunction(Codegen& cg, const FunctionInstance& inst)
 
 static void codegenPrepare(Codegen& cg)
 {
+	// MachO doesn't support comdats; linkonce_odr symbols are coalesced by the linker regardless
+	cg.comdats = !Triple(cg.module->getTargetTriple()).isOSBinFormatMachO();
+
 	cg.builtinTrap = Intrinsic::getDeclaration(cg.module, Intrinsic::trap);
 	cg.builtinDebugTrap = Intrinsic::getDeclaration(cg.module, Intrinsic::debugtrap);
 
 	cg.runtimeNew = cg.module->getOrInsertFunction("gcNew", Type::getInt8PtrTy(*cg.context), Type::getInt8PtrTy(*cg.context), Type::getInt32Ty(*cg.context), nullptr);
 	cg.runtimeNewArray = cg.module->getOrInsertFunction("gcNewArray", Type::getInt8PtrTy(*cg.context), Type::getInt8PtrTy(*cg.context), Type::getInt32Ty(*cg.context), Type::getInt32Ty(*cg.context), nullptr);
+	cg.runtimeRoot = cg.module->getOrInsertFunction("gcRoot", Type::getVoidTy(*cg.context), Type::getInt8PtrTy(*cg.context), Type::getInt32Ty(*cg.context), nullptr);
+}
+
+string codegenEntryName(const Str& moduleName)
+{
+	return moduleName.str() + ".entry";
 }
 
 llvm::Value* codegen(Output& output, Ast* root, llvm::Module* module, const CodegenOptions& options)
@@ -1525,17 +1673,17 @@ llvm::Value* codegen(Output& output, Ast* root, llvm::Module* module, const Code
 
 		// It's necessary to use "." as the directory instead of an empty string for debug info to work on OSX
 		DICompileUnit* cu = cg.di->createCompileUnit(dwarf::DW_LANG_C,
-			entryLocation.source, ".", "aikec", /* isOptimized= */ false, StringRef(), 0, StringRef(), kind);
+			sourceResolve(entryLocation).source, ".", "aikec", /* isOptimized= */ false, StringRef(), 0, StringRef(), kind);
 		cg.debugBlocks.push_back(cu);
 	}
 
-	string entryName = rootModule->name.str() + ".entry";
+	string entryName = codegenEntryName(rootModule->name);
 
 	FunctionType* entryType = FunctionType::get(Type::getVoidTy(*cg.context), false);
-	Function* entry = Function::Create(entryType, GlobalValue::InternalLinkage, entryName, module);
+	Function* entry = Function::Create(entryType, GlobalValue::ExternalLinkage, entryName, module);
 
-	Variable* entryVar = new Variable { Variable::KindFunction, Str(entryName.c_str()), nullptr, entryLocation, nullptr };
-	Ast::FnDecl* entryDecl = new Ast::FnDecl { nullptr, Location(), entryVar, Arr<Ty*>(), Arr<Variable*>(), 0, root };
+	Variable* entryVar = ARENA_NEW(Variable) { Variable::KindFunction, Str(entryName.c_str()), nullptr, entryLocation, nullptr };
+	Ast::FnDecl* entryDecl = ARENA_NEW(Ast::FnDecl) { nullptr, Location(), entryVar, Arr<Ty*>(), Arr<Variable*>(), 0, root };
 
 	cg.pendingFunctions.push_back(new FunctionInstance { entry, entryDecl });
 
@@ -1558,7 +1706,7 @@ llvm::Value* codegen(Output& output, Ast* root, llvm::Module* module, const Code
 	return entry;
 }
 
-void codegenMain(llvm::Module* module, const vector<llvm::Value*>& entries)
+void codegenMain(llvm::Module* module, const vector<string>& entries)
 {
 	LLVMContext& context = module->getContext();
 	IRBuilder<> ir(context);
@@ -1569,7 +1717,7 @@ void codegenMain(llvm::Module* module, const vector<llvm::Value*>& entries)
 	ir.SetInsertPoint(mainbb);
 
 	for (auto& e: entries)
-		ir.CreateCall(e);
+		ir.CreateCall(module->getOrInsertFunction(e, Type::getVoidTy(context), nullptr));
 
 	ir.CreateRetVoid();
 
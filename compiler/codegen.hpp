@@ -12,8 +12,16 @@ struct Ast;
 struct CodegenOptions
 {
 	int debugInfo;
+
+	// analyzes the body of a function that was parsed lazily; called when the function is instantiated
+	function<bool (Ast*)> loadBody;
+
+	// emits top-level variables as external globals; used by the REPL where each entry is a separate module
+	bool globals;
 };
 
+string codegenEntryName(const Str& moduleName);
+
 llvm::Value* codegen(Output& output, Ast* root, llvm::Module* module, const CodegenOptions& options);
 
-void codegenMain(llvm::Module* module, const vector<llvm::Value*>& entries);
\ No newline at end of file
+void codegenMain(llvm::Module* module, const vector<string>& entries);
\ No newline at end of file
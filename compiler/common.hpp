@@ -13,6 +13,7 @@
 
 #include <memory>
 #include <utility>
+#include <type_traits>
 
 #include <algorithm>
 #include <functional>
@@ -33,6 +34,7 @@ ATTR_NORETURN ATTR_PRINTF(1, 2) void panic(const char* format, ...);
 #define ICE_STRINGIFY(x) ICE_STRINGIFY_IMPL(x)
 #define ICE(...) panic(__FILE__ "(" ICE_STRINGIFY(__LINE__) "): Internal compiler error: " __VA_ARGS__)
 
+#include "arena.hpp"
 #include "string.hpp"
 #include "array.hpp"
 #include "union.hpp"
\ No newline at end of file
@@ -12,6 +12,12 @@
 #include "target.hpp"
 #include "dump.hpp"
 #include "timer.hpp"
+#include "parallel.hpp"
+#include "cache.hpp"
+#include "interface.hpp"
+#include "server.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
 #include "ast.hpp"
 
 #include "llvm/IR/LLVMContext.h"
@@ -28,6 +34,12 @@
 #include <fstream>
 #include <deque>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 struct Options
 {
 	vector<string> inputs;
@@ -35,10 +47,17 @@ struct Options
 
 	string triple;
 
+	string cachePath;
+	string compilerVersion;
+	bool disableCache;
+
 	int optimize;
 	int debugInfo;
+	int jobs;
 	bool coverage;
 	bool compileOnly;
+	bool run;
+	bool repl;
 	bool disablePrelude;
 
 	bool dumpParse;
@@ -46,6 +65,9 @@ struct Options
 	bool dumpLLVM;
 	bool dumpAsm;
 	bool time;
+	bool memoryStats;
+	bool typeckStats;
+	string trace;
 };
 
 Options parseOptions(int argc, const char** argv)
@@ -62,6 +84,10 @@ Options parseOptions(int argc, const char** argv)
 				result.output = argv[++i];
 			else if (arg == "-c")
 				result.compileOnly = true;
+			else if (arg == "--run")
+				result.run = true;
+			else if (arg == "--repl")
+				result.repl = true;
 			else if (arg == "--dump-parse")
 				result.dumpParse = true;
 			else if (arg == "--dump-ast")
@@ -72,16 +98,31 @@ Options parseOptions(int argc, const char** argv)
 				result.dumpAsm = true;
 			else if (arg == "--time")
 				result.time = true;
+			else if (arg == "--mem-stats")
+				result.memoryStats = true;
+			else if (arg == "--typeck-stats")
+				result.typeckStats = true;
+			else if (arg.str().compare(0, 8, "--trace=") == 0)
+				result.trace = arg.str().substr(8);
 			else if (arg.str().compare(0, 2, "-O") == 0)
 				result.optimize = (arg == "-O") ? 2 : atoi(arg.str().c_str() + 2);
 			else if (arg.str().compare(0, 2, "-g") == 0)
 				result.debugInfo = (arg == "-g") ? 2 : atoi(arg.str().c_str() + 2);
+			else if (arg.str().compare(0, 2, "-j") == 0 && arg.size > 2)
+				result.jobs = atoi(arg.str().c_str() + 2);
 			else if (arg == "-coverage")
 				result.coverage = true;
 			else if (arg == "-noprelude")
 				result.disablePrelude = true;
+			else if (arg == "--cache-dir" && i + 1 < argc)
+				result.cachePath = argv[++i];
+			else if (arg == "--no-cache")
+				result.disableCache = true;
 			else if (arg.str().compare(0, 6, "--llvm") == 0)
 			{
+				// arbitrary LLVM options can change the generated code
+				result.disableCache = true;
+
 				string opt = arg.str().substr(6);
 
 				const char* opts[] = { argv[0], opt.c_str() };
@@ -101,24 +142,43 @@ Options parseOptions(int argc, const char** argv)
 	if (result.coverage)
 		result.debugInfo = max(result.debugInfo, 1);
 
+	if (result.jobs <= 0)
+		result.jobs = ThreadPool::getDefaultThreads();
+
+	if (result.cachePath.empty())
+		result.cachePath = cacheGetDefaultPath();
+
+	result.compilerVersion = cacheGetCompilerVersion(argv[0]);
+
 	return result;
 }
 
 pair<bool, Str> readFile(const char* path)
 {
-	FILE* file = fopen(path, "rb");
-	if (!file) return { false, Str() };
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return { false, Str() };
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return { false, Str() };
+	}
+
+	// mmap can't map empty files
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return { true, Str("") };
+	}
 
-	fseek(file, 0, SEEK_END);
-	long length = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	// Sources are never unmapped since tokens and AST nodes refer to the contents for the lifetime of the compiler
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 
-	char* result = new char[length];
-	fread(result, 1, length, file);
-	int error = ferror(file);
-	fclose(file);
+	if (data == MAP_FAILED) return { false, Str() };
 
-	return { error == 0, Str(result, length) };
+	return { true, Str(static_cast<const char*>(data), st.st_size) };
 }
 
 Str getModuleName(const char* path)
@@ -151,7 +211,7 @@ string getModulePath(const Str& name)
 		return path + ".aike";
 }
 
-Ast* parseModule(Timer& timer, Output& output, const char* source, const Str& contents, const Str& moduleName, const Options& options)
+Ast* parseModule(Timer& timer, Output& output, const char* source, const Str& contents, const Str& moduleName, bool lazyBodies = false)
 {
 	timer.checkpoint();
 
@@ -159,52 +219,34 @@ Ast* parseModule(Timer& timer, Output& output, const char* source, const Str& co
 
 	timer.checkpoint("tokenize");
 
-	Ast* root = parse(output, tokens, moduleName);
+	Ast* root = parse(output, tokens, moduleName, lazyBodies);
 
 	timer.checkpoint("parse");
 
-	if (options.dumpParse)
-	{
-		dump(root);
-	}
-
 	return root;
 }
 
-llvm::Value* compileModule(Timer& timer, Output& output, llvm::Module* module, Ast* root, ModuleResolver* moduleResolver, const Options& options)
+bool analyzeModule(Timer& timer, Output& output, Ast* root, ModuleResolver* moduleResolver, const Options& options, TypeckStats* typeckStats)
 {
 	timer.checkpoint();
 
 	resolveNames(output, root, moduleResolver);
 
 	if (output.errors)
-		return nullptr;
+		return false;
 
 	timer.checkpoint("resolveNames");
 
-	int fixpoint;
-
-	do
 	{
-		fixpoint = 0;
-
-		timer.checkpoint();
-
-		fixpoint += typeckPropagate(output, root);
-
-		if (output.errors)
-			return nullptr;
-
-		timer.checkpoint("typeckPropagate");
+		TraceScope trace("typeckSolve");
 
-		fixpoint += resolveMembers(output, root);
+		typeckSolve(output, root, typeckStats);
 
 		if (output.errors)
-			return nullptr;
+			return false;
 
-		timer.checkpoint("resolveMembers");
+		timer.checkpoint("typeckSolve");
 	}
-	while (fixpoint != 0);
 
 	if (options.dumpAst)
 	{
@@ -216,95 +258,495 @@ llvm::Value* compileModule(Timer& timer, Output& output, llvm::Module* module, A
 	typeckVerify(output, root);
 
 	if (output.errors)
-		return nullptr;
+		return false;
 
 	timer.checkpoint("typeckVerify");
 
-	llvm::Value* entry = codegen(output, root, module, { options.debugInfo });
+	return true;
+}
+
+// Function declarations don't have a location of their own
+static Location getNodeLocation(Ast* node)
+{
+	if (UNION_CASE(FnDecl, n, node))
+		return n->var->location;
+
+	return astLocation(node);
+}
+
+static string getNodeText(Ast* node)
+{
+	if (UNION_CASE(FnDecl, n, node))
+		return "fn " + n->var->name.str();
+
+	SourcePosition pos = sourceResolve(astLocation(node));
+
+	if (!pos.contents.data)
+		return string();
+
+	size_t length = 0;
+
+	while (length < pos.length && length < 40 && pos.contents[pos.offset + length] != '\r' && pos.contents[pos.offset + length] != '\n')
+		length++;
+
+	return string(pos.contents.data + pos.offset, length);
+}
+
+// Every line starts with the module source so that the report can be matched per module like diagnostics
+static void dumpTypeckStats(const char* source, const Str& moduleName, const TypeckStats& stats)
+{
+	printf("%s: typeck %s: %d rounds\n", source, moduleName.str().c_str(), int(stats.rounds.size()));
+
+	for (size_t i = 0; i < stats.rounds.size(); ++i)
+	{
+		const TypeckRound& round = stats.rounds[i];
+
+		printf("%s: round %d: %d units, %d rewrites, %d unknown\n", source, int(i + 1), round.units, round.rewrites, int(round.unknowns.size()));
+
+		for (auto& u: round.unknowns)
+		{
+			SourcePosition pos = sourceResolve(getNodeLocation(u.first));
+
+			printf("%s(%d,%d): %s: %s\n", pos.source, pos.line + 1, pos.column + 1, getNodeText(u.first).c_str(), typeName(u.second).c_str());
+		}
+	}
+}
+
+// Analyzes the body of a top-level function that wasn't parsed with the module
+static bool analyzeFunctionBody(Output& output, Ast* decl, ModuleResolver* moduleResolver)
+{
+	parseLazyBody(output, decl);
+
+	resolveFunctionBody(output, decl, moduleResolver);
+
+	if (output.errors)
+		return false;
+
+	typeckSolve(output, decl);
+
+	if (output.errors)
+		return false;
+
+	typeckVerify(output, decl);
+
+	return output.errors == 0;
+}
+
+bool codegenModule(Timer& timer, Output& output, llvm::Module* module, Ast* root, const Options& options, ModuleResolver* moduleResolver)
+{
+	timer.checkpoint();
+
+	auto loadBody = [&](Ast* decl) { return analyzeFunctionBody(output, decl, moduleResolver); };
+
+	codegen(output, root, module, { options.debugInfo, loadBody, options.repl });
 
 	if (output.errors)
-		return nullptr;
+		return false;
 
 	timer.checkpoint("codegen");
 
-	return entry;
+	return true;
+}
+
+// Modules analyzed by the compiler server ahead of time; requests are served by forked processes that inherit them
+struct WarmModules
+{
+	struct Module
+	{
+		string path;
+
+		const char* source;
+		Str contents;
+
+		string key;
+		Ast* root;
+	};
+
+	unordered_map<Str, Module> modules;
+	bool disablePrelude;
+
+	ModuleInterfaces interfaces;
+};
+
+struct PendingModule
+{
+	Str name;
+	Location import;
+	string path;
+
+	const char* source;
+	Str contents;
+	Ast* root;
+
+	// if the module has an up-to-date interface file or has been analyzed by the server, the module isn't parsed
+	InterfaceFile* interface;
+	WarmModules::Module* warm;
+
+	// function bodies of imported modules are parsed on first use
+	bool lazyBodies;
+
+	// tokenize/parse and semantic analysis run on worker threads, so they get their own diagnostics and timings
+	Output output;
+	Timer timer;
+
+	bool found;
+	bool failed;
+	bool done;
+
+	// the module is analyzed from source in this compilation
+	bool analyzing;
+
+	TypeckStats typeckStats;
+};
+
+struct ModulePanic
+{
+};
+
+static void parsePendingModule(PendingModule& pm, bool useInterfaces, WarmModules* warm, const Options& options)
+{
+	TraceScope trace("module", pm.name);
+
+	pm.source = strdup(pm.path.c_str());
+
+	auto contents = readFile(pm.source);
+
+	if (!contents.first)
+		return;
+
+	pm.found = true;
+	pm.contents = contents.second;
+
+	pm.timer.count("mapped bytes", pm.contents.size);
+
+	if (warm)
+	{
+		auto it = warm->modules.find(pm.name);
+
+		if (it != warm->modules.end() && it->second.path == pm.path && it->second.contents == pm.contents)
+		{
+			// locations in the analyzed module refer to the original source
+			pm.warm = &it->second;
+			pm.source = pm.warm->source;
+			pm.contents = pm.warm->contents;
+			return;
+		}
+	}
+
+	sourceRegister(pm.source, pm.contents);
+
+	if (useInterfaces)
+	{
+		pm.timer.checkpoint();
+
+		pm.interface = interfaceOpen(interfaceGetPath(pm.path), options.compilerVersion, pm.source, pm.contents, pm.lazyBodies);
+
+		pm.timer.checkpoint("interface");
+
+		if (pm.interface)
+			return;
+	}
+
+	pm.output.panicHandler = [](const Location&) { throw ModulePanic(); };
+
+	try
+	{
+		pm.root = parseModule(pm.timer, pm.output, pm.source, pm.contents, pm.name, pm.lazyBodies);
+	}
+	catch (ModulePanic&)
+	{
+		pm.failed = true;
+	}
+}
+
+// Creates a module with the same imports as the one stored in the interface file; it's used to sort the modules before the interfaces are loaded
+static Ast* createModuleStub(const PendingModule& pm)
+{
+	Arr<Ast*> imports;
+
+	for (auto& i: pm.interface->imports)
+		imports.push(UNION_NEW(Ast, Import, { nullptr, i.second, i.first }));
+
+	Location location(sourceGetBase(pm.source), 0);
+
+	Ast* body = UNION_NEW(Ast, Block, { nullptr, location, imports });
+
+	return UNION_NEW(Ast, Module, { nullptr, location, pm.name, body });
+}
+
+static void addAutoimports(const PendingModule& pm, const Options& options)
+{
+	if (!options.disablePrelude)
+	{
+		if (UNION_CASE(Module, m, pm.root))
+			if (pm.name != "std.prelude")
+				m->autoimports.push(Str("std.prelude"));
+	}
 }
 
-bool compileModules(vector<llvm::Value*>& entries, Timer& timer, Output& output, llvm::Module* module, const Options& options)
+bool compileModules(vector<string>& entries, Timer& timer, Output& output, const function<llvm::Module* (const Str&, const string&)>& getModule, const Options& options,
+	WarmModules* warm, const vector<Str>& imports)
 {
 	vector<Ast*> modules;
-	unordered_map<Str, unsigned int> readyModules;
+	unordered_map<unsigned int, unsigned int> readyModules;
 
 	ModuleResolver resolver;
 
 	resolver.lookup = [&](Str name) -> Ast* {
-		auto it = readyModules.find(name);
+		auto it = readyModules.find(symbolGet(name));
 		if (it == readyModules.end()) return nullptr;
 
 		return modules[it->second];
 	};
 
-	struct PendingModule
-	{
-		Str name;
-		Location import;
-		string path;
-	};
+	// interface files can't be used when dumping the untyped AST, and when dumping typed AST we need to analyze all modules
+	bool useInterfaces = !options.disableCache && !options.compilerVersion.empty() && !options.dumpParse && !options.dumpAst;
+
+	if (warm && (warm->disablePrelude != options.disablePrelude || options.dumpParse || options.dumpAst))
+		warm = nullptr;
 
-	deque<PendingModule> pendingModules;
+	// function bodies of imported modules are analyzed when codegen reaches them, except for dumps that should show all of them
+	bool lazyBodies = !options.dumpParse && !options.dumpAst;
 
 	timer.checkpoint("startup");
 
+	// Modules are parsed on the pool as soon as they are discovered, but the results are consumed
+	// in discovery order; this is the same order a sequential breadth-first traversal would use,
+	// which keeps diagnostics and module numbering deterministic.
+	vector<unique_ptr<PendingModule>> pendingModules;
+	unordered_set<Str> scheduledModules;
+
+	mutex pendingLock;
+	condition_variable pendingDone;
+
+	ThreadPool pool(options.jobs > 1 ? options.jobs : 0);
+
+	// modules parsed on the pool are allocated in the arena of the calling thread
+	Arena* arena = arenaGetCurrent();
+
+	auto schedule = [&](Str name, Location import, const string& path, bool imported) {
+		if (!scheduledModules.insert(name).second)
+			return;
+
+		PendingModule* pm = new PendingModule();
+		pm->name = name;
+		pm->import = import;
+		pm->path = path;
+		pm->lazyBodies = lazyBodies && imported;
+
+		pendingModules.emplace_back(pm);
+
+		pool.push([&, pm]() {
+			ArenaScope scope(arena);
+
+			parsePendingModule(*pm, useInterfaces, warm, options);
+
+			lock_guard<mutex> l(pendingLock);
+
+			pm->done = true;
+			pendingDone.notify_all();
+		});
+	};
+
 	for (auto& file: options.inputs)
-		pendingModules.push_back({ getModuleName(file.c_str()), Location(), file });
+		schedule(getModuleName(file.c_str()), Location(), file, false);
 
-	while (!pendingModules.empty())
-	{
-		auto pm = pendingModules.front();
-		pendingModules.pop_front();
+	for (auto& name: imports)
+		schedule(name, Location(), getModulePath(name), false);
 
-		if (readyModules.count(pm.name))
-			continue;
+	for (size_t i = 0; i < pendingModules.size(); ++i)
+	{
+		PendingModule& pm = *pendingModules[i];
 
-		const char* source = strdup(pm.path.c_str());
+		{
+			unique_lock<mutex> l(pendingLock);
+			pendingDone.wait(l, [&]() { return pm.done; });
+		}
 
-		auto contents = readFile(source);
+		timer.merge(pm.timer);
 
-		if (!contents.first)
+		if (!pm.found)
 		{
 			output.error(pm.import, "Cannot find module %s", pm.name.str().c_str());
 			return false;
 		}
 
-		output.sources[source] = contents.second;
-
-		Ast* root = parseModule(timer, output, source, contents.second, pm.name, options);
+		if (pm.failed)
+		{
+			output.messages.insert(output.messages.end(), pm.output.messages.begin(), pm.output.messages.end());
+			return false;
+		}
 
-		if (!options.disablePrelude)
+		if (pm.warm)
+		{
+			pm.root = pm.warm->root;
+		}
+		else
 		{
-			if (UNION_CASE(Module, m, root))
-				if (pm.name != "std.prelude")
-					m->autoimports.push(Str("std.prelude"));
+			if (pm.interface)
+				pm.root = createModuleStub(pm);
+
+			if (options.dumpParse)
+			{
+				dump(pm.root);
+			}
+
+			addAutoimports(pm, options);
 		}
 
-		moduleGatherImports(root, [&](Str name, Location location) {
-			pendingModules.push_back({ name, location, getModulePath(name) });
+		moduleGatherImports(pm.root, [&](Str name, Location location) {
+			schedule(name, location, getModulePath(name), true);
 		});
 
-		readyModules[pm.name] = modules.size();
-		modules.push_back(root);
+		readyModules[symbolGet(pm.name)] = modules.size();
+		modules.push_back(pm.root);
 	}
 
-	vector<unsigned int> moduleOrder = moduleSort(output, modules);
+	timer.checkpoint();
+
+	vector<vector<unsigned int>> moduleLevels = moduleSort(output, modules);
 
-	for (auto& i: moduleOrder)
+	if (output.errors)
+		return false;
+
+	// Module key covers the module source and the keys of all imported modules; since imports are
+	// compiled first, this makes the key depend on the sources of all transitively imported modules
+	unordered_map<Str, string> moduleKeys;
+
+	ModuleInterfaces localInterfaces;
+	ModuleInterfaces& interfaces = warm ? warm->interfaces : localInterfaces;
+
+	// AST dumps are printed during analysis, so their order has to match the module order
+	ThreadPool serialPool(0);
+	ThreadPool& analysisPool = options.dumpAst ? serialPool : pool;
+
+	for (auto& level: moduleLevels)
 	{
-		llvm::Value* entrypoint = compileModule(timer, output, module, modules[i], &resolver, options);
+		vector<PendingModule*> pendingAnalysis;
 
-		if (!entrypoint)
-			return false;
+		for (auto& i: level)
+		{
+			PendingModule& pm = *pendingModules[i];
+
+			TraceScope trace("module", pm.name);
+
+			CacheHash hash;
+
+			hash.update(pm.name);
+			hash.update(pm.contents);
+
+			moduleGatherImports(pm.root, [&](Str name, Location location) {
+				hash.update(name);
+				hash.update(moduleKeys[name]);
+			});
+
+			string& key = moduleKeys[pm.name];
+			key = hash.str();
+
+			bool analyzed = pm.warm && pm.warm->key == key;
+
+			if (!analyzed && pm.interface)
+			{
+				timer.checkpoint();
+
+				if (Ast* root = interfaceLoad(interfaces, pm.interface, pm.name, pm.source, key))
+				{
+					pm.root = modules[i] = root;
+					analyzed = true;
+				}
+
+				timer.checkpoint("interface");
+			}
+
+			// the module wasn't parsed since we expected to reuse the analyzed module, but one of the imports has changed
+			if (!analyzed && (pm.warm || pm.interface))
+			{
+				pm.root = modules[i] = parseModule(timer, output, pm.source, pm.contents, pm.name, pm.lazyBodies);
+
+				if (output.errors)
+					return false;
+
+				addAutoimports(pm, options);
+			}
+
+			if (!analyzed)
+			{
+				pm.analyzing = true;
+				pendingAnalysis.push_back(&pm);
+			}
+		}
+
+		// Modules of the same level don't import each other, so they are analyzed concurrently;
+		// diagnostics are merged in module order, which keeps them identical to a sequential run
+		parallelFor(analysisPool, pendingAnalysis.size(), [&](size_t index) {
+			PendingModule& pm = *pendingAnalysis[index];
+
+			ArenaScope scope(arena);
+			TraceScope trace("module", pm.name);
+
+			pm.output = Output();
+			pm.output.panicHandler = [](const Location&) { throw ModulePanic(); };
+
+			pm.timer = Timer();
+
+			try
+			{
+				pm.failed = !analyzeModule(pm.timer, pm.output, pm.root, &resolver, options, options.typeckStats ? &pm.typeckStats : nullptr);
+			}
+			catch (ModulePanic&)
+			{
+				pm.failed = true;
+			}
+		});
+
+		for (auto& i: level)
+		{
+			PendingModule& pm = *pendingModules[i];
+
+			TraceScope trace("module", pm.name);
 
-		entries.push_back(entrypoint);
+			const string& key = moduleKeys[pm.name];
+
+			if (pm.analyzing)
+			{
+				timer.merge(pm.timer);
+
+				if (options.typeckStats)
+					dumpTypeckStats(pm.source, pm.name, pm.typeckStats);
+
+				output.messages.insert(output.messages.end(), pm.output.messages.begin(), pm.output.messages.end());
+				output.errors += pm.output.errors;
+				output.warnings += pm.output.warnings;
+
+				if (pm.failed)
+					return false;
+
+				if (useInterfaces || warm)
+				{
+					timer.checkpoint();
+
+					interfaceRegister(interfaces, pm.root, pm.name, pm.source, key);
+
+					// the interface would lose the warnings, so we'll analyze the module from source next time
+					if (useInterfaces && pm.output.warnings == 0)
+						interfaceWrite(interfaces, interfaceGetPath(pm.path), options.compilerVersion, pm.contents, key);
+
+					timer.checkpoint("interface");
+				}
+			}
+
+			if (warm)
+				warm->modules[pm.name] = { pm.path, pm.source, pm.contents, key, pm.root };
+
+			// the module is null if the object for this module has been loaded from the cache
+			if (llvm::Module* module = getModule(pm.name, key))
+			{
+				if (!codegenModule(timer, output, module, pm.root, options, &resolver))
+					return false;
+			}
+
+			entries.push_back(codegenEntryName(pm.name));
+		}
 	}
 
 	return output.errors == 0;
@@ -319,24 +761,28 @@ string getRuntimePath(const string& compilerPath)
 	return path + "aike-runtime.so";
 }
 
-int main(int argc, const char** argv)
+struct CodegenUnit
 {
-	Options options = parseOptions(argc, argv);
-
-	Timer timer;
+	unique_ptr<llvm::LLVMContext> context;
+	unique_ptr<llvm::Module> module;
 
-	Output output;
-
-	targetInitialize();
+	string object;
 
-	string triple = options.triple.empty() ? targetHostTriple() : options.triple;
+	// units with a cache key are stored in the object cache after assembly; cached units don't have a module
+	string cacheKey;
+	bool cached;
+};
 
-	llvm::LLVMContext context;
+void createUnitModule(CodegenUnit* unit, const string& name, const string& triple, const llvm::DataLayout& layout, const Options& options)
+{
+	// Each unit has its own context so that units can be optimized and assembled concurrently
+	unit->context.reset(new llvm::LLVMContext());
+	unit->module.reset(new llvm::Module(name, *unit->context));
 
-	llvm::Module* module = new llvm::Module("main", context);
+	llvm::Module* module = unit->module.get();
 
 	module->setTargetTriple(triple);
-	module->setDataLayout(targetDataLayout(triple));
+	module->setDataLayout(layout);
 
 	if (options.debugInfo)
 	{
@@ -345,76 +791,552 @@ int main(int argc, const char** argv)
 		if (llvm::Triple(triple).isOSDarwin())
 			module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 2);
 	}
+}
 
-	vector<llvm::Value*> entries;
-
-	if (!compileModules(entries, timer, output, module, options))
-	{
-		output.flush();
-		return 1;
-	}
+// Every REPL entry is compiled to a separate module that autoimports all previous entries with declarations;
+// analyzed modules are kept in the session and machine code is added to the JIT incrementally
+struct ReplSession
+{
+	Options options;
 
-	codegenMain(module, entries);
+	string triple;
+	llvm::DataLayout layout;
 
-	timer.checkpoint();
+	TargetJit* jit;
 
-	assert(!verifyModule(*module, &llvm::errs()));
+	WarmModules modules;
+	unordered_map<Str, string> compiledModules;
 
-	timer.checkpoint("verify");
+	vector<unique_ptr<CodegenUnit>> units;
 
-	transformOptimize(module, options.optimize);
+	vector<Str> declarations;
+	unsigned int counter;
+};
 
-	timer.checkpoint("optimize");
+static void replRunUnits(ReplSession& session, Timer& timer, const vector<CodegenUnit*>& units, const vector<string>& entries)
+{
+	const Options& options = session.options;
 
-	for (auto& fun: *module)
-		fun.addFnAttr("no-frame-pointer-elim", "true");
+	timer.checkpoint();
 
-	if (options.debugInfo)
+	for (auto& unit: units)
 	{
-		transformMergeDebugInfo(module);
+		llvm::Module* module = unit->module.get();
 
-		timer.checkpoint("debuginfo");
-	}
+		assert(!verifyModule(*module, &llvm::errs()));
 
-	if (options.coverage)
-	{
-		transformCoverage(module);
+		transformOptimize(module, options.optimize);
 
-		timer.checkpoint("coverage");
+		for (auto& fun: *module)
+			fun.addFnAttr("no-frame-pointer-elim", "true");
+
+		if (options.debugInfo)
+			transformMergeDebugInfo(module);
+
+		targetJitAdd(session.jit, move(unit->module));
+	}
+
+	timer.checkpoint("optimize");
+
+	auto runtimeEntry = reinterpret_cast<int (*)(void (*)())>(targetJitGetFunction(session.jit, "aikeEntry"));
+
+	if (!runtimeEntry)
+		panic("Error running program: can't find aikeEntry");
+
+	for (auto& e: entries)
+	{
+		auto entry = reinterpret_cast<void (*)()>(targetJitGetFunction(session.jit, e));
+
+		if (!entry)
+			panic("Error running program: can't find %s", e.c_str());
+
+		timer.checkpoint("jit");
+
+		runtimeEntry(entry);
+
+		fflush(stdout);
+
+		timer.checkpoint("run");
+	}
+}
+
+static CodegenUnit* replCreateUnit(ReplSession& session, const Str& name)
+{
+	CodegenUnit* unit = new CodegenUnit();
+	session.units.emplace_back(unit);
+
+	createUnitModule(unit, name.str(), session.triple, session.layout, session.options);
+
+	return unit;
+}
+
+// Compiles the imported modules that haven't been loaded yet and runs their top-level code
+static bool replCompileModules(ReplSession& session, Timer& timer, Output& output, const vector<Str>& imports)
+{
+	vector<CodegenUnit*> units;
+	vector<string> entries;
+
+	auto getModule = [&](const Str& name, const string& key) -> llvm::Module* {
+		auto it = session.compiledModules.find(name);
+
+		if (it != session.compiledModules.end() && it->second == key)
+			return nullptr;
+
+		session.compiledModules[name] = key;
+
+		CodegenUnit* unit = replCreateUnit(session, name);
+
+		units.push_back(unit);
+		entries.push_back(codegenEntryName(name));
+
+		return unit->module.get();
+	};
+
+	vector<string> allEntries;
+
+	if (!compileModules(allEntries, timer, output, getModule, session.options, &session.modules, imports))
+		return false;
+
+	replRunUnits(session, timer, units, entries);
+
+	return true;
+}
+
+static bool hasDeclarations(Ast* root)
+{
+	UNION_CASE(Module, m, root);
+	assert(m);
+
+	UNION_CASE(Block, b, m->body);
+	assert(b);
+
+	for (auto& c: b->body)
+		if (c->kind == Ast::KindFnDecl || c->kind == Ast::KindTyDecl || c->kind == Ast::KindVarDecl)
+			return true;
+
+	return false;
+}
+
+// Returns false if the entry failed to compile; entries that end prematurely are incomplete unless they span multiple lines
+static bool replRunEntry(ReplSession& session, const string& text, bool multiline, bool& incomplete)
+{
+	const Options& options = session.options;
+
+	Timer timer;
+	Output output;
+
+	string name = "repl" + to_string(++session.counter);
+
+	Str moduleName = Str::copy(name.c_str());
+	const char* source = strdup(name.c_str());
+	Str contents = Str::copy(text.c_str());
+
+	sourceRegister(source, contents);
+
+	output.panicHandler = [&](const Location& location) {
+		// parse errors at the end of the input have an empty location
+		incomplete = !multiline && location.offset == 0;
+
+		throw ModulePanic();
+	};
+
+	try
+	{
+		Ast* root = parseModule(timer, output, source, contents, moduleName);
+
+		UNION_CASE(Module, m, root);
+
+		// the entry only has comments
+		if (!m)
+			return true;
+
+		if (!options.disablePrelude)
+			m->autoimports.push(Str("std.prelude"));
+
+		for (auto& d: session.declarations)
+			m->autoimports.push(d);
+
+		vector<Str> imports;
+
+		moduleGatherImports(root, [&](Str import, Location location) {
+			if (session.modules.modules.count(import) == 0)
+				imports.push_back(import);
+		});
+
+		if (!imports.empty() && !replCompileModules(session, timer, output, imports))
+		{
+			output.flush();
+			return false;
+		}
+
+		ModuleResolver resolver;
+
+		resolver.lookup = [&](Str name) -> Ast* {
+			auto it = session.modules.modules.find(name);
+			if (it == session.modules.modules.end()) return nullptr;
+
+			return it->second.root;
+		};
+
+		resolver.exportVariables = true;
+		resolver.shadowImports = true;
+
+		TypeckStats typeckStats;
+
+		bool analyzed = analyzeModule(timer, output, root, &resolver, options, options.typeckStats ? &typeckStats : nullptr);
+
+		if (options.typeckStats)
+			dumpTypeckStats(source, moduleName, typeckStats);
+
+		if (!analyzed)
+		{
+			output.flush();
+			return false;
+		}
+
+		CodegenUnit* unit = replCreateUnit(session, moduleName);
+
+		if (!codegenModule(timer, output, unit->module.get(), root, options, &resolver))
+		{
+			output.flush();
+			return false;
+		}
+
+		session.modules.modules[moduleName] = { string(), source, contents, string(), root };
+
+		if (hasDeclarations(root))
+			session.declarations.push_back(moduleName);
+
+		output.flush();
+
+		replRunUnits(session, timer, { unit }, { codegenEntryName(moduleName) });
+	}
+	catch (ModulePanic&)
+	{
+		if (!incomplete)
+			output.flush();
+
+		return false;
+	}
+
+	if (options.time)
+	{
+		timer.dump();
+	}
+
+	return true;
+}
+
+static bool replReadLine(const char* prompt, string& line)
+{
+	// prompts are only shown in interactive sessions so that the output of piped sessions only has the results
+	if (isatty(STDIN_FILENO))
+	{
+		fputs(prompt, stdout);
+		fflush(stdout);
+	}
+
+	line.clear();
+
+	int ch;
+
+	while ((ch = getchar()) != EOF && ch != '\n')
+		line += char(ch);
+
+	return ch != EOF || !line.empty();
+}
+
+int runRepl(const char* compilerPath, const Options& options)
+{
+	targetInitialize();
+
+	ReplSession session = { options, targetHostTriple(), llvm::DataLayout("") };
+
+	session.layout = targetDataLayout(session.triple);
+	session.jit = targetJitCreate(getRuntimePath(compilerPath), options.optimize);
+
+	session.modules.disablePrelude = options.disablePrelude;
+
+	// input files are loaded before the first entry, and their declarations are visible to all entries
+	{
+		Timer timer;
+		Output output;
+
+		vector<Str> imports;
+
+		if (!options.disablePrelude)
+			imports.push_back(Str("std.prelude"));
+
+		if (!replCompileModules(session, timer, output, imports))
+		{
+			output.flush();
+			return 1;
+		}
+
+		for (auto& file: options.inputs)
+			session.declarations.push_back(getModuleName(file.c_str()));
+
+		session.options.inputs.clear();
+	}
+
+	string text;
+	string line;
+
+	while (replReadLine(text.empty() ? "> " : "... ", line))
+	{
+		// once an entry spans multiple lines, it is terminated by an empty line
+		if (!text.empty() && !line.empty())
+		{
+			text += "\n";
+			text += line;
+			continue;
+		}
+
+		bool multiline = !text.empty();
+
+		if (!multiline)
+			text = line;
+
+		if (text.find_first_not_of(" \t") == string::npos)
+		{
+			text.clear();
+			continue;
+		}
+
+		bool incomplete = false;
+
+		replRunEntry(session, text, multiline, incomplete);
+
+		if (!incomplete)
+			text.clear();
+	}
+
+	targetJitDestroy(session.jit);
+
+	return 0;
+}
+
+int compile(int argc, const char** argv, WarmModules* warm)
+{
+	// all AST nodes, types and variables are allocated in the arena and released when compilation finishes;
+	// modules that are kept warm between requests are allocated in the arena of the server instead
+	Arena arena;
+	ArenaScope arenaScope(warm ? arenaGetCurrent() : &arena);
+
+	Options options = parseOptions(argc, argv);
+
+	if (!options.trace.empty())
+		traceStart();
+
+	if (options.repl)
+	{
+		int result = runRepl(argv[0], options);
+
+		if (!options.trace.empty() && !traceWrite(options.trace))
+			panic("Error writing trace to %s", options.trace.c_str());
+
+		return result;
+	}
+
+	Timer timer;
+
+	Output output;
+
+	targetInitialize();
+
+	string triple = options.triple.empty() ? targetHostTriple() : options.triple;
+
+	llvm::DataLayout layout = targetDataLayout(triple);
+
+	// Every Aike module is compiled to a separate LLVM module, unless we need a single object file (-c), a single
+	// module to run in JIT or coverage data that would otherwise be emitted for every source file once per unit
+	bool singleUnit = options.compileOnly || options.run || options.coverage;
+
+	// Cached objects are only useful when we're producing an executable from several units
+	bool useCache = !singleUnit && !options.disableCache && !options.cachePath.empty() && !options.compilerVersion.empty() &&
+		!options.output.empty() && !options.dumpLLVM && !options.dumpAsm;
+
+	unsigned int cacheHits = 0;
+	unsigned int cacheMisses = 0;
+
+	vector<unique_ptr<CodegenUnit>> units;
+
+	auto getModule = [&](const Str& name, const string& key) -> llvm::Module* {
+		if (singleUnit && !units.empty())
+			return units[0]->module.get();
+
+		CodegenUnit* unit = new CodegenUnit();
+		units.emplace_back(unit);
+
+		if (useCache && !key.empty())
+		{
+			CacheHash hash;
+
+			hash.update(options.compilerVersion);
+			hash.update(triple);
+			hash.update(options.optimize);
+			hash.update(options.debugInfo);
+			hash.update(key);
+
+			unit->cacheKey = hash.str();
+
+			if (cacheLoad(options.cachePath, unit->cacheKey, unit->object))
+			{
+				unit->cached = true;
+				cacheHits++;
+
+				return nullptr;
+			}
+
+			cacheMisses++;
+		}
+
+		createUnitModule(unit, singleUnit ? "main" : name.str(), triple, layout, options);
+
+		return unit->module.get();
+	};
+
+	vector<string> entries;
+
+	if (!compileModules(entries, timer, output, getModule, options, warm, vector<Str>()))
+	{
+		output.flush();
+
+		if (!options.trace.empty())
+			traceWrite(options.trace);
+
+		return 1;
+	}
+
+	if (useCache)
+	{
+		timer.count("cache hits", cacheHits);
+		timer.count("cache misses", cacheMisses);
+	}
+
+	codegenMain(getModule(Str("main"), string()), entries);
+
+	// cached units already have an object file and don't need to go through the rest of the pipeline
+	vector<CodegenUnit*> pendingUnits;
+
+	for (auto& unit: units)
+		if (!unit->cached)
+			pendingUnits.push_back(unit.get());
+
+	ThreadPool pool(options.jobs > 1 ? options.jobs : 0);
+
+	timer.checkpoint();
+
+	parallelFor(pool, pendingUnits.size(), [&](size_t i) {
+		llvm::Module* module = pendingUnits[i]->module.get();
+
+		TraceScope trace("verify", Str(module->getName().data(), module->getName().size()));
+
+		assert(!verifyModule(*module, &llvm::errs()));
+	});
+
+	timer.checkpoint("verify");
+
+	parallelFor(pool, pendingUnits.size(), [&](size_t i) {
+		llvm::Module* module = pendingUnits[i]->module.get();
+
+		TraceScope trace("optimize", Str(module->getName().data(), module->getName().size()));
+
+		transformOptimize(module, options.optimize);
+
+		for (auto& fun: *module)
+			fun.addFnAttr("no-frame-pointer-elim", "true");
+	});
+
+	timer.checkpoint("optimize");
+
+	if (options.debugInfo)
+	{
+		parallelFor(pool, pendingUnits.size(), [&](size_t i) {
+			transformMergeDebugInfo(pendingUnits[i]->module.get());
+		});
+
+		timer.checkpoint("debuginfo");
+	}
+
+	if (options.coverage)
+	{
+		for (auto& unit: pendingUnits)
+			transformCoverage(unit->module.get());
+
+		timer.checkpoint("coverage");
 	}
 
 	if (options.dumpLLVM)
 	{
-		module->print(llvm::outs(), 0);
+		for (auto& unit: pendingUnits)
+			unit->module->print(llvm::outs(), 0);
 	}
 
 	if (options.dumpAsm)
 	{
-		string result = targetAssembleText(triple, module, options.optimize);
+		for (auto& unit: pendingUnits)
+		{
+			string result = targetAssembleText(triple, unit->module.get(), options.optimize);
 
-		puts(result.c_str());
+			puts(result.c_str());
+		}
 	}
 
-	if (!options.output.empty())
+	int result = 0;
+
+	if (options.run)
+	{
+		assert(units.size() == 1);
+
+		string runtimePath = getRuntimePath(argv[0]);
+
+		// the program output should follow compiler diagnostics
+		output.flush();
+		fflush(stdout);
+
+		timer.checkpoint();
+
+		result = targetRun(move(units[0]->module), runtimePath, options.optimize);
+
+		timer.checkpoint("run");
+	}
+	else if (!options.output.empty())
 	{
 		timer.checkpoint();
 
-		string result = targetAssembleBinary(triple, module, options.optimize);
+		parallelFor(pool, pendingUnits.size(), [&](size_t i) {
+			CodegenUnit* unit = pendingUnits[i];
+
+			TraceScope trace("assemble", Str(unit->module->getName().data(), unit->module->getName().size()));
+
+			unit->object = targetAssembleBinary(triple, unit->module.get(), options.optimize);
+
+			if (!unit->cacheKey.empty())
+				cacheStore(options.cachePath, unit->cacheKey, unit->object);
+		});
 
 		timer.checkpoint("assemble");
 
 		if (options.compileOnly)
 		{
+			assert(units.size() == 1);
+
 			ofstream of(options.output, ios::out | ios::binary);
-			of.write(result.c_str(), result.size());
+			of.write(units[0]->object.c_str(), units[0]->object.size());
 		}
 		else
 		{
 			string runtimePath = getRuntimePath(argv[0]);
 
+			vector<string> objects;
+
+			for (auto& unit: units)
+				objects.push_back(unit->object);
+
 			timer.checkpoint();
 
-			targetLink(triple, options.output, { result }, runtimePath, options.debugInfo);
+			targetLink(triple, options.output, objects, runtimePath, options.debugInfo);
 
 			timer.checkpoint("link");
 		}
@@ -427,6 +1349,95 @@ int main(int argc, const char** argv)
 		timer.dump();
 	}
 
+	if (options.memoryStats)
+	{
+		timer.dumpMemory();
+	}
+
+	if (!options.trace.empty() && !traceWrite(options.trace))
+		panic("Error writing trace to %s", options.trace.c_str());
+
 	llvm::PrintStatistics();
 	llvm::TimerGroup::printAll(llvm::outs());
+
+	return result;
+}
+
+vector<Str> getLibraryModules()
+{
+	vector<Str> result;
+
+	if (DIR* dir = opendir("library"))
+	{
+		while (dirent* entry = readdir(dir))
+		{
+			string name = entry->d_name;
+
+			if (name.size() > 5 && name.compare(name.size() - 5, 5, ".aike") == 0)
+				result.push_back(Str::copy(("std." + name.substr(0, name.size() - 5)).c_str()));
+		}
+
+		closedir(dir);
+	}
+
+	sort(result.begin(), result.end());
+
+	return result;
+}
+
+int runServer(const char* compilerPath, const char* socketPath)
+{
+	// requests change the working directory, and the compiler path is used to locate the runtime
+	char* path = realpath(compilerPath, nullptr);
+	string compiler = path ? path : compilerPath;
+
+	const char* argv[] = { compiler.c_str() };
+	Options options = parseOptions(1, argv);
+
+	targetInitialize();
+	targetDataLayout(targetHostTriple());
+
+	WarmModules warm = {};
+	warm.disablePrelude = options.disablePrelude;
+
+	// warm modules are used by all requests, so their arena is never released
+	Arena* arena = new Arena();
+	ArenaScope arenaScope(arena);
+
+	{
+		Timer timer;
+		Output output;
+		vector<string> entries;
+
+		// the library is analyzed once; requests reuse it unless the sources have changed
+		compileModules(entries, timer, output, [](const Str&, const string&) -> llvm::Module* { return nullptr; }, options, &warm, getLibraryModules());
+
+		output.flush();
+	}
+
+	return serverRun(socketPath, [&](const vector<string>& args) -> int {
+		vector<const char*> argv = { compiler.c_str() };
+
+		for (auto& a: args)
+			argv.push_back(a.c_str());
+
+		return compile(argv.size(), argv.data(), &warm);
+	});
+}
+
+int main(int argc, const char** argv)
+{
+	if (argc == 3 && strcmp(argv[1], "--server") == 0)
+		return runServer(argv[0], argv[2]);
+
+	// with AIKE_SERVER set, the compiler is a thin client that forwards the command line to the server
+	if (const char* server = getenv("AIKE_SERVER"))
+	{
+		int rc = serverConnect(server, vector<string>(argv + 1, argv + argc));
+
+		if (rc >= 0)
+			return rc;
+	}
+
+	return compile(argc, argv, nullptr);
 }
\ No newline at end of file
@@ -0,0 +1,1028 @@
+#include "common.hpp"
+#include "interface.hpp"
+
+#include "ast.hpp"
+#include "tokenize.hpp"
+#include "visit.hpp"
+#include "cache.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
+
+#include <chrono>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Interface files hold the entire module after typechecking - this includes function bodies since each module
+// instantiates the functions it calls from imported modules in its own LLVM module. Bodies of imported functions
+// that were never used are stored as token ranges and are parsed from the source when they are first needed.
+//
+// Layout:
+//   magic, format version, compiler version, source hash, lazy body flag, explicit imports
+//   module key, stamp, referenced modules with their stamps, location sources
+//   object table (category + kind), object contents
+//
+// Pointers are stored as object references: own objects are stored by index, objects from
+// imported modules are stored by (module, index); the stamp makes sure that the imported module
+// has been loaded from the exact same interface file it was in when this interface was written.
+
+static const char kInterfaceMagic[4] = { 'A', 'I', 'K', 'I' };
+static const unsigned int kInterfaceVersion = 4;
+
+enum InterfaceCategory
+{
+	CategoryAst,
+	CategoryTy,
+	CategoryTyDef,
+	CategoryVariable,
+};
+
+#define COUNT(...) + 1
+
+static const int kAstKindCount = 0 UD_AST(COUNT);
+static const int kTyKindCount = 0 UD_TY(COUNT);
+static const int kTyDefKindCount = 0 UD_TYDEF(COUNT);
+
+#undef COUNT
+
+template <typename T, typename M> static T* getContainer(M* data, M T::* member)
+{
+	alignas(T) char probe[sizeof(T)];
+	size_t offset = reinterpret_cast<char*>(&(reinterpret_cast<T*>(probe)->*member)) - probe;
+
+	return reinterpret_cast<T*>(reinterpret_cast<char*>(data) - offset);
+}
+
+template <typename S> static void transfer(S& s, Ast* node)
+{
+	s(node->dataCommon.type);
+	s(node->dataCommon.location);
+
+	if (UNION_CASE(LiteralBool, n, node))
+		s(n->value);
+	else if (UNION_CASE(LiteralInteger, n, node))
+		s(n->value);
+	else if (UNION_CASE(LiteralFloat, n, node))
+		s(n->value);
+	else if (UNION_CASE(LiteralString, n, node))
+		s(n->value);
+	else if (UNION_CASE(LiteralTuple, n, node))
+		s(n->fields);
+	else if (UNION_CASE(LiteralArray, n, node))
+		s(n->elements);
+	else if (UNION_CASE(LiteralStruct, n, node))
+	{
+		s(n->name);
+		s(n->fields);
+	}
+	else if (UNION_CASE(Ident, n, node))
+	{
+		s(n->name);
+		s(n->tyargs);
+		s(n->targets);
+		s(n->resolved);
+	}
+	else if (UNION_CASE(Member, n, node))
+	{
+		s(n->expr);
+		s(n->field);
+	}
+	else if (UNION_CASE(Block, n, node))
+		s(n->body);
+	else if (UNION_CASE(Module, n, node))
+	{
+		s(n->name);
+		s(n->body);
+		s(n->autoimports);
+	}
+	else if (UNION_CASE(Call, n, node))
+	{
+		s(n->expr);
+		s(n->args);
+	}
+	else if (UNION_CASE(Unary, n, node))
+	{
+		s(n->op);
+		s(n->expr);
+	}
+	else if (UNION_CASE(Binary, n, node))
+	{
+		s(n->op);
+		s(n->left);
+		s(n->right);
+	}
+	else if (UNION_CASE(Index, n, node))
+	{
+		s(n->expr);
+		s(n->index);
+	}
+	else if (UNION_CASE(Assign, n, node))
+	{
+		s(n->left);
+		s(n->right);
+	}
+	else if (UNION_CASE(If, n, node))
+	{
+		s(n->cond);
+		s(n->thenbody);
+		s(n->elsebody);
+	}
+	else if (UNION_CASE(For, n, node))
+	{
+		s(n->var);
+		s(n->index);
+		s(n->expr);
+		s(n->body);
+	}
+	else if (UNION_CASE(While, n, node))
+	{
+		s(n->expr);
+		s(n->body);
+	}
+	else if (UNION_CASE(Fn, n, node))
+	{
+		s(n->id);
+		s(n->decl);
+	}
+	else if (UNION_CASE(LLVM, n, node))
+		s(n->code);
+	else if (UNION_CASE(FnDecl, n, node))
+	{
+		s(n->var);
+		s(n->tyargs);
+		s(n->args);
+		s(n->attributes);
+		s(n->body);
+		s(n->parent);
+		s(n->module);
+		s(n->lazy);
+	}
+	else if (UNION_CASE(VarDecl, n, node))
+	{
+		s(n->var);
+		s(n->expr);
+	}
+	else if (UNION_CASE(TyDecl, n, node))
+	{
+		s(n->name);
+		s(n->def);
+	}
+	else if (UNION_CASE(Import, n, node))
+		s(n->name);
+}
+
+template <typename S> static void transfer(S& s, Ty* type)
+{
+	if (UNION_CASE(Tuple, t, type))
+		s(t->fields);
+	else if (UNION_CASE(Array, t, type))
+		s(t->element);
+	else if (UNION_CASE(Pointer, t, type))
+		s(t->element);
+	else if (UNION_CASE(Function, t, type))
+	{
+		s(t->args);
+		s(t->ret);
+		s(t->varargs);
+	}
+	else if (UNION_CASE(Instance, t, type))
+	{
+		s(t->name);
+		s(t->location);
+		s(t->tyargs);
+		s(t->def);
+		s(t->generic);
+	}
+	else if (UNION_CASE(Generic, t, type))
+	{
+		s(t->name);
+		s(t->location);
+	}
+}
+
+template <typename S> static void transfer(S& s, TyDef* def)
+{
+	if (UNION_CASE(Struct, d, def))
+	{
+		s(d->tyargs);
+		s(d->fields);
+	}
+	else
+		ICE("Unknown TyDef kind %d", def->kind);
+}
+
+template <typename S> static void transfer(S& s, Variable* var)
+{
+	s(var->kind);
+	s(var->name);
+	s(var->type);
+	s(var->location);
+	s(var->fn);
+}
+
+template <typename S> static void transfer(S& s, FieldRef& field)
+{
+	s(field.name);
+	s(field.location);
+	s(field.index);
+}
+
+template <typename S> static void transfer(S& s, StructField& field)
+{
+	s(field.name);
+	s(field.location);
+	s(field.type);
+	s(field.expr);
+}
+
+template <typename S> static void transfer(S& s, pair<FieldRef, Ast*>& field)
+{
+	s(field.first);
+	s(field.second);
+}
+
+template <typename S> static void transfer(S& s, const ModuleInterfaces::Object& object)
+{
+	switch (object.category)
+	{
+	case CategoryAst: transfer(s, static_cast<Ast*>(object.data)); break;
+	case CategoryTy: transfer(s, static_cast<Ty*>(object.data)); break;
+	case CategoryTyDef: transfer(s, static_cast<TyDef*>(object.data)); break;
+	case CategoryVariable: transfer(s, static_cast<Variable*>(object.data)); break;
+	default: ICE("Unknown object category %d", object.category);
+	}
+}
+
+static int getKind(const ModuleInterfaces::Object& object)
+{
+	switch (object.category)
+	{
+	case CategoryAst: return static_cast<Ast*>(object.data)->kind;
+	case CategoryTy: return static_cast<Ty*>(object.data)->kind;
+	case CategoryTyDef: return static_cast<TyDef*>(object.data)->kind;
+	case CategoryVariable: return 0;
+	default: ICE("Unknown object category %d", object.category);
+	}
+}
+
+struct InterfaceGatherer
+{
+	ModuleInterfaces* interfaces;
+	size_t module;
+
+	vector<ModuleInterfaces::Object> pending;
+
+	void object(int category, void* data)
+	{
+		if (!data)
+			return;
+
+		auto& objects = interfaces->modules[module].objects;
+
+		if (interfaces->objectIndices.insert(make_pair(data, make_pair(module, objects.size()))).second)
+		{
+			objects.push_back({ category, data });
+			pending.push_back({ category, data });
+		}
+	}
+
+	void operator()(Ast*& value) { object(CategoryAst, value); }
+	void operator()(Ty*& value) { object(CategoryTy, value); }
+	void operator()(TyDef*& value) { object(CategoryTyDef, value); }
+	void operator()(Variable*& value) { object(CategoryVariable, value); }
+
+	void operator()(Ast::FnDecl*& value) { object(CategoryAst, value ? getContainer(value, &Ast::dataFnDecl) : nullptr); }
+	void operator()(Ast::Module*& value) { object(CategoryAst, value ? getContainer(value, &Ast::dataModule) : nullptr); }
+
+	void operator()(Str& value) {}
+	void operator()(Location& value) {}
+	void operator()(LazyBody*& value) {}
+
+	void operator()(FieldRef& value) { transfer(*this, value); }
+	void operator()(StructField& value) { transfer(*this, value); }
+	void operator()(pair<FieldRef, Ast*>& value) { transfer(*this, value); }
+
+	template <typename T> void operator()(Arr<T>& value)
+	{
+		for (auto& e: value)
+			(*this)(e);
+	}
+
+	template <typename T> void operator()(T& value)
+	{
+		static_assert(is_arithmetic<T>::value || is_enum<T>::value, "Unsupported field type");
+	}
+};
+
+struct InterfaceWriter
+{
+	const ModuleInterfaces* interfaces;
+	size_t module;
+
+	unordered_map<size_t, size_t> dependencies;
+	vector<size_t> dependencyList;
+
+	unordered_map<const char*, size_t> sources;
+	vector<const char*> sourceList;
+
+	string data;
+
+	void write(const void* value, size_t size)
+	{
+		data.append(static_cast<const char*>(value), size);
+	}
+
+	void rawString(const Str& value)
+	{
+		varint(value.size);
+		write(value.data, value.size);
+	}
+
+	void varint(unsigned long long value)
+	{
+		do
+		{
+			unsigned char byte = value & 127;
+			value >>= 7;
+
+			if (value)
+				byte |= 128;
+
+			data.push_back(byte);
+		}
+		while (value);
+	}
+
+	void object(const void* value)
+	{
+		if (!value)
+			return varint(0);
+
+		auto it = interfaces->objectIndices.find(value);
+		assert(it != interfaces->objectIndices.end());
+
+		if (it->second.first == module)
+			varint(it->second.second * 2 + 1);
+		else
+		{
+			auto dit = dependencies.find(it->second.first);
+
+			if (dit == dependencies.end())
+			{
+				dit = dependencies.insert(make_pair(it->second.first, dependencyList.size())).first;
+				dependencyList.push_back(it->second.first);
+			}
+
+			varint((dit->second + 1) * 2);
+			varint(it->second.second);
+		}
+	}
+
+	void operator()(Ast*& value) { object(value); }
+	void operator()(Ty*& value) { object(value); }
+	void operator()(TyDef*& value) { object(value); }
+	void operator()(Variable*& value) { object(value); }
+
+	void operator()(Ast::FnDecl*& value) { object(value ? getContainer(value, &Ast::dataFnDecl) : nullptr); }
+	void operator()(Ast::Module*& value) { object(value ? getContainer(value, &Ast::dataModule) : nullptr); }
+
+	// identifiers are marked so that the reader can intern them
+	void operator()(Str& value)
+	{
+		varint(value.size * 2 + (value.symbol != 0));
+		write(value.data, value.size);
+	}
+
+	// locations are stored relative to the source; empty locations are stored as 0
+	void operator()(Location& value)
+	{
+		if (value.offset == 0)
+			return varint(0);
+
+		SourcePosition pos = sourceResolve(value);
+
+		auto it = sources.find(pos.source);
+
+		if (it == sources.end())
+		{
+			it = sources.insert(make_pair(pos.source, sourceList.size())).first;
+			sourceList.push_back(pos.source);
+		}
+
+		varint(it->second + 1);
+		varint(pos.offset);
+		varint(pos.length);
+	}
+
+	// tokens are not stored; the source is tokenized again when the body is parsed
+	void operator()(LazyBody*& value)
+	{
+		if (!value)
+			return varint(0);
+
+		varint(value->begin + 1);
+		varint(value->end);
+		(*this)(value->indent);
+	}
+
+	void operator()(FieldRef& value) { transfer(*this, value); }
+	void operator()(StructField& value) { transfer(*this, value); }
+	void operator()(pair<FieldRef, Ast*>& value) { transfer(*this, value); }
+
+	template <typename T> void operator()(Arr<T>& value)
+	{
+		varint(value.size);
+
+		for (auto& e: value)
+			(*this)(e);
+	}
+
+	template <typename T> void operator()(T& value)
+	{
+		static_assert(is_arithmetic<T>::value || is_enum<T>::value, "Unsupported field type");
+
+		write(&value, sizeof(value));
+	}
+};
+
+struct InterfaceReader
+{
+	const char* data;
+	size_t size;
+	size_t offset;
+
+	bool failed;
+
+	const ModuleInterfaces* interfaces;
+
+	vector<ModuleInterfaces::Object> objects;
+	vector<size_t> dependencies;
+	vector<const char*> sources;
+
+	// lazy bodies of the module share the tokens
+	Tokens* tokens;
+
+	void read(void* value, size_t count)
+	{
+		if (failed || size - offset < count)
+		{
+			failed = true;
+			memset(value, 0, count);
+			return;
+		}
+
+		memcpy(value, data + offset, count);
+		offset += count;
+	}
+
+	unsigned long long varint()
+	{
+		unsigned long long result = 0;
+
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			unsigned char byte = 0;
+			read(&byte, 1);
+
+			result |= (unsigned long long)(byte & 127) << shift;
+
+			if ((byte & 128) == 0)
+				return result;
+		}
+
+		failed = true;
+		return 0;
+	}
+
+	Str string()
+	{
+		size_t length = varint();
+
+		if (failed || size - offset < length)
+		{
+			failed = true;
+			return Str();
+		}
+
+		Str result(data + offset, length);
+		offset += length;
+
+		return result;
+	}
+
+	void* object(int category)
+	{
+		unsigned long long value = varint();
+
+		if (value == 0)
+			return nullptr;
+
+		const ModuleInterfaces::Object* result = nullptr;
+
+		if (value & 1)
+		{
+			size_t index = value / 2;
+
+			if (index < objects.size())
+				result = &objects[index];
+		}
+		else
+		{
+			size_t dependency = value / 2 - 1;
+			size_t index = varint();
+
+			if (dependency < dependencies.size())
+			{
+				auto& module = interfaces->modules[dependencies[dependency]];
+
+				if (index < module.objects.size())
+					result = &module.objects[index];
+			}
+		}
+
+		if (!result || result->category != category)
+		{
+			failed = true;
+			return nullptr;
+		}
+
+		return result->data;
+	}
+
+	void operator()(Ast*& value) { value = static_cast<Ast*>(object(CategoryAst)); }
+	void operator()(Ty*& value) { value = static_cast<Ty*>(object(CategoryTy)); }
+	void operator()(TyDef*& value) { value = static_cast<TyDef*>(object(CategoryTyDef)); }
+	void operator()(Variable*& value) { value = static_cast<Variable*>(object(CategoryVariable)); }
+
+	void operator()(Ast::FnDecl*& value)
+	{
+		Ast* node = static_cast<Ast*>(object(CategoryAst));
+
+		if (node && node->kind != Ast::KindFnDecl)
+			failed = true;
+
+		value = (node && !failed) ? &node->dataFnDecl : nullptr;
+	}
+
+	void operator()(Ast::Module*& value)
+	{
+		Ast* node = static_cast<Ast*>(object(CategoryAst));
+
+		if (node && node->kind != Ast::KindModule)
+			failed = true;
+
+		value = (node && !failed) ? &node->dataModule : nullptr;
+	}
+
+	void operator()(Str& value)
+	{
+		size_t header = varint();
+		size_t length = header / 2;
+
+		if (failed || size - offset < length)
+		{
+			failed = true;
+			value = Str();
+			return;
+		}
+
+		value = Str(data + offset, length);
+		offset += length;
+
+		if (header & 1)
+			value = symbolIntern(value);
+	}
+
+	void operator()(Location& value)
+	{
+		size_t source = varint();
+
+		if (source == 0)
+		{
+			value = Location();
+			return;
+		}
+
+		// all sources the module refers to must be loaded to resolve the locations
+		unsigned int base = source - 1 < sources.size() ? sourceGetBase(sources[source - 1]) : 0;
+
+		size_t offset = varint();
+		size_t length = varint();
+
+		if (base == 0 || offset + length > ~0u - base)
+		{
+			failed = true;
+			return;
+		}
+
+		value = Location(base + offset, length);
+	}
+
+	void operator()(LazyBody*& value)
+	{
+		size_t begin = varint();
+
+		if (begin == 0)
+		{
+			value = nullptr;
+			return;
+		}
+
+		size_t end = varint();
+
+		Location indent;
+		(*this)(indent);
+
+		if (end < begin - 1)
+		{
+			failed = true;
+			return;
+		}
+
+		if (!tokens)
+			tokens = ARENA_NEW(Tokens)();
+
+		value = ARENA_NEW(LazyBody) { tokens, begin - 1, end, indent };
+	}
+
+	void operator()(FieldRef& value) { transfer(*this, value); }
+	void operator()(StructField& value) { transfer(*this, value); }
+	void operator()(pair<FieldRef, Ast*>& value) { transfer(*this, value); }
+
+	template <typename T> void operator()(Arr<T>& value)
+	{
+		size_t count = varint();
+
+		// every element takes at least one byte; this protects the allocation below from garbage counts
+		if (failed || count > size - offset)
+		{
+			failed = true;
+			value = Arr<T>();
+			return;
+		}
+
+		value = count ? Arr<T>(count) : Arr<T>();
+
+		for (auto& e: value)
+			(*this)(e);
+	}
+
+	template <typename T> void operator()(T& value)
+	{
+		static_assert(is_arithmetic<T>::value || is_enum<T>::value, "Unsupported field type");
+
+		read(&value, sizeof(value));
+	}
+};
+
+static unsigned long long getSourceHash(const Str& contents)
+{
+	CacheHash hash;
+	hash.update(contents);
+
+	return hash.value;
+}
+
+static unsigned long long getStamp(const string& key)
+{
+	CacheHash hash;
+
+	hash.update(key);
+	hash.update(static_cast<long long>(chrono::high_resolution_clock::now().time_since_epoch().count()));
+	hash.update(static_cast<long long>(getpid()));
+
+	return hash.value;
+}
+
+static void registerSource(ModuleInterfaces& interfaces, const char* source)
+{
+	interfaces.sources.insert(make_pair(string(source), source));
+}
+
+string interfaceGetPath(const string& sourcePath)
+{
+	return sourcePath + "i";
+}
+
+InterfaceFile* interfaceOpen(const string& path, const string& compilerVersion, const char* source, const Str& contents, bool lazyBodies)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return nullptr;
+
+	InterfaceReader reader = { static_cast<const char*>(data), size_t(st.st_size) };
+
+	char magic[4];
+	reader.read(magic, sizeof(magic));
+
+	unsigned int version = 0;
+	reader(version);
+
+	Str interfaceCompilerVersion = reader.string();
+
+	unsigned long long sourceHash = 0;
+	reader(sourceHash);
+
+	bool interfaceLazyBodies = false;
+	reader(interfaceLazyBodies);
+
+	if (reader.failed || memcmp(magic, kInterfaceMagic, sizeof(magic)) != 0 || version != kInterfaceVersion ||
+		interfaceCompilerVersion != Str(compilerVersion.c_str()) || sourceHash != getSourceHash(contents) ||
+		(interfaceLazyBodies && !lazyBodies))
+	{
+		munmap(data, st.st_size);
+		return nullptr;
+	}
+
+	reader.sources.push_back(source);
+
+	vector<pair<Str, Location>> imports;
+
+	size_t importCount = reader.varint();
+
+	for (size_t i = 0; i < importCount && !reader.failed; ++i)
+	{
+		Str name = reader.string();
+
+		Location location;
+		reader(location);
+
+		imports.push_back(make_pair(name, location));
+	}
+
+	if (reader.failed)
+	{
+		munmap(data, st.st_size);
+		return nullptr;
+	}
+
+	return new InterfaceFile { reader.data, reader.size, imports, reader.offset };
+}
+
+Ast* interfaceLoad(ModuleInterfaces& interfaces, InterfaceFile* file, const Str& name, const char* source, const string& key)
+{
+	InterfaceReader reader = { file->data, file->size, file->offset, false, &interfaces };
+
+	if (reader.string() != Str(key.c_str()))
+		return nullptr;
+
+	unsigned long long stamp = 0;
+	reader(stamp);
+
+	size_t dependencyCount = reader.varint();
+
+	for (size_t i = 0; i < dependencyCount && !reader.failed; ++i)
+	{
+		Str dependency = reader.string();
+
+		unsigned long long dependencyStamp = 0;
+		reader(dependencyStamp);
+
+		auto it = interfaces.moduleIndices.find(dependency);
+
+		if (it == interfaces.moduleIndices.end() || interfaces.modules[it->second].stamp != dependencyStamp)
+			return nullptr;
+
+		reader.dependencies.push_back(it->second);
+	}
+
+	reader.sources.push_back(source);
+
+	size_t sourceCount = reader.varint();
+
+	for (size_t i = 0; i < sourceCount && !reader.failed; ++i)
+	{
+		Str path = reader.string();
+		auto it = interfaces.sources.find(path.str());
+
+		// locations can only be resolved in sources that have been loaded
+		if (it == interfaces.sources.end())
+			return nullptr;
+
+		reader.sources.push_back(it->second);
+	}
+
+	size_t objectCount = reader.varint();
+
+	if (reader.failed || objectCount == 0 || objectCount > file->size)
+		return nullptr;
+
+	for (size_t i = 0; i < objectCount; ++i)
+	{
+		unsigned char category = 0, kind = 0;
+		reader(category);
+		reader(kind);
+
+		if (reader.failed)
+			return nullptr;
+
+		void* data = nullptr;
+
+		switch (category)
+		{
+		case CategoryAst:
+			if (kind < kAstKindCount) data = ARENA_NEW(Ast) { Ast::Kind(kind), { 0 } };
+			break;
+
+		case CategoryTy:
+			if (kind < kTyKindCount) data = ARENA_NEW(Ty) { Ty::Kind(kind), { 0 } };
+			break;
+
+		case CategoryTyDef:
+			if (kind < kTyDefKindCount) data = ARENA_NEW(TyDef) { TyDef::Kind(kind), { 0 } };
+			break;
+
+		case CategoryVariable:
+			data = ARENA_NEW(Variable)();
+			break;
+		}
+
+		if (!data)
+			return nullptr;
+
+		reader.objects.push_back({ category, data });
+	}
+
+	for (auto& o: reader.objects)
+	{
+		transfer(reader, o);
+
+		if (reader.failed)
+			return nullptr;
+	}
+
+	Ast* root = static_cast<Ast*>(reader.objects[0].data);
+
+	if (reader.objects[0].category != CategoryAst || root->kind != Ast::KindModule)
+		return nullptr;
+
+	// the interface is valid, so we can register its objects so that subsequent modules can refer to them
+	size_t module = interfaces.modules.size();
+
+	interfaces.modules.push_back({ name, stamp });
+	interfaces.moduleIndices[name] = module;
+
+	for (size_t i = 0; i < reader.objects.size(); ++i)
+		interfaces.objectIndices[reader.objects[i].data] = make_pair(module, i);
+
+	interfaces.modules[module].objects = move(reader.objects);
+
+	registerSource(interfaces, source);
+
+	return root;
+}
+
+void interfaceRegister(ModuleInterfaces& interfaces, Ast* root, const Str& name, const char* source, const string& key)
+{
+	size_t module = interfaces.modules.size();
+
+	interfaces.modules.push_back({ name, getStamp(key) });
+	interfaces.moduleIndices[name] = module;
+
+	InterfaceGatherer gatherer = { &interfaces, module };
+
+	gatherer(root);
+
+	while (!gatherer.pending.empty())
+	{
+		ModuleInterfaces::Object object = gatherer.pending.back();
+		gatherer.pending.pop_back();
+
+		transfer(gatherer, object);
+	}
+
+	registerSource(interfaces, source);
+}
+
+bool interfaceWrite(const ModuleInterfaces& interfaces, const string& path, const string& compilerVersion, const Str& contents, const string& key)
+{
+	assert(!interfaces.modules.empty());
+
+	size_t module = interfaces.modules.size() - 1;
+
+	auto& objects = interfaces.modules[module].objects;
+
+	Ast* root = static_cast<Ast*>(objects[0].data);
+	assert(root->kind == Ast::KindModule);
+
+	InterfaceWriter writer = { &interfaces, module };
+
+	const char* source = sourceResolve(root->dataModule.location).source;
+
+	writer.sources[source] = 0;
+	writer.sourceList.push_back(source);
+
+	// header
+	InterfaceWriter header = writer;
+
+	header.write(kInterfaceMagic, sizeof(kInterfaceMagic));
+	header.write(&kInterfaceVersion, sizeof(kInterfaceVersion));
+
+	header.rawString(Str(compilerVersion.c_str()));
+
+	unsigned long long sourceHash = getSourceHash(contents);
+	header(sourceHash);
+
+	vector<Ast::Import*> imports;
+	bool lazyBodies = false;
+
+	visitAst(root, [&](Ast* node) -> bool {
+		if (UNION_CASE(Import, n, node))
+			imports.push_back(n);
+		else if (UNION_CASE(FnDecl, n, node))
+			lazyBodies |= n->lazy != nullptr;
+
+		return false;
+	});
+
+	header(lazyBodies);
+
+	header.varint(imports.size());
+
+	for (auto& i: imports)
+	{
+		header.rawString(i->name);
+		header(i->location);
+	}
+
+	// objects
+	for (auto& o: objects)
+		transfer(writer, o);
+
+	// module key and object references
+	InterfaceWriter body = writer;
+	body.data.clear();
+
+	body.rawString(Str(key.c_str()));
+
+	unsigned long long stamp = interfaces.modules[module].stamp;
+	body(stamp);
+
+	body.varint(writer.dependencyList.size());
+
+	for (auto& d: writer.dependencyList)
+	{
+		Str dependency = interfaces.modules[d].name;
+		unsigned long long dependencyStamp = interfaces.modules[d].stamp;
+
+		body.rawString(dependency);
+		body(dependencyStamp);
+	}
+
+	// source 0 is the module itself
+	body.varint(writer.sourceList.size() - 1);
+
+	for (size_t i = 1; i < writer.sourceList.size(); ++i)
+	{
+		body.rawString(Str(writer.sourceList[i]));
+	}
+
+	body.varint(objects.size());
+
+	for (auto& o: objects)
+	{
+		unsigned char category = o.category;
+		unsigned char kind = getKind(o);
+
+		body(category);
+		body(kind);
+	}
+
+	string result = header.data;
+	result += body.data;
+	result += writer.data;
+
+	// Several compiler processes may write the same interface concurrently; rename makes sure readers never see partial files
+	string temp = path + ".tmp" + to_string(getpid());
+
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool written = fwrite(result.data(), 1, result.size(), file) == result.size();
+	written &= fclose(file) == 0;
+
+	if (!written || rename(temp.c_str(), path.c_str()) != 0)
+	{
+		unlink(temp.c_str());
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
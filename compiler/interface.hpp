@@ -0,0 +1,53 @@
+#pragma once
+
+#include "location.hpp"
+
+struct Ast;
+
+// Objects (AST nodes, types, type definitions and variables) of all modules analyzed so far
+// Interface files reference objects from imported modules by index in the owning module
+struct ModuleInterfaces
+{
+	struct Object
+	{
+		int category;
+		void* data;
+	};
+
+	struct Module
+	{
+		Str name;
+		unsigned long long stamp;
+
+		vector<Object> objects;
+	};
+
+	vector<Module> modules;
+
+	unordered_map<Str, size_t> moduleIndices;
+	unordered_map<const void*, pair<size_t, size_t>> objectIndices;
+
+	unordered_map<string, const char*> sources;
+};
+
+// Interface file that has been mapped and matches the module source; it may still be stale if any of the imports changed
+struct InterfaceFile
+{
+	const char* data;
+	size_t size;
+
+	// module imports, excluding autoimports
+	vector<pair<Str, Location>> imports;
+
+	size_t offset;
+};
+
+string interfaceGetPath(const string& sourcePath);
+
+// Interfaces with function bodies that haven't been analyzed are only opened if lazyBodies is set
+InterfaceFile* interfaceOpen(const string& path, const string& compilerVersion, const char* source, const Str& contents, bool lazyBodies);
+
+Ast* interfaceLoad(ModuleInterfaces& interfaces, InterfaceFile* file, const Str& name, const char* source, const string& key);
+
+void interfaceRegister(ModuleInterfaces& interfaces, Ast* root, const Str& name, const char* source, const string& key);
+bool interfaceWrite(const ModuleInterfaces& interfaces, const string& path, const string& compilerVersion, const Str& contents, const string& key);
\ No newline at end of file
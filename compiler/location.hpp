@@ -1,31 +1,26 @@
 #pragma once
 
+// Locations are compact: the offset is global across all registered sources (see source.hpp), and it is
+// resolved to a source file, line and column only when needed, e.g. to print a diagnostic
+// Offset 0 is reserved for locations that don't point to any source
 struct Location
 {
-	const char* source;
+	unsigned int offset;
+	unsigned int length;
 
-	int line;
-	int column;
-
-	size_t offset;
-	size_t length;
-
-	Location(): source(""), line(0), column(0), offset(0), length(0)
+	Location(): offset(0), length(0)
 	{
 	}
 
-	Location(const char* source, int line, int column, size_t offset, size_t length): source(source), line(line), column(column), offset(offset), length(length)
+	Location(size_t offset, size_t length): offset(offset), length(length)
 	{
+		assert(this->offset == offset && this->length == length);
 	}
 
 	Location(const Location& lhs, const Location& rhs)
 	{
-		assert(lhs.source == rhs.source);
 		assert(lhs.offset + lhs.length <= rhs.offset);
 
-		source = lhs.source;
-		line = lhs.line;
-		column = lhs.column;
 		offset = lhs.offset;
 		length = rhs.offset + rhs.length - lhs.offset;
 	}
@@ -0,0 +1,88 @@
+#include "common.hpp"
+#include "memory.hpp"
+
+#include <new>
+
+#include <sys/resource.h>
+
+static thread_local MemoryCounters gMemoryCounters;
+
+static void* memoryAllocate(size_t size)
+{
+	gMemoryCounters.allocations++;
+	gMemoryCounters.bytes += size;
+
+	// operator new must return a unique pointer for zero-sized allocations
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+	if (void* result = memoryAllocate(size))
+		return result;
+
+	throw bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	if (void* result = memoryAllocate(size))
+		return result;
+
+	throw bad_alloc();
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	return memoryAllocate(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+	return memoryAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, const nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, const nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+MemoryCounters memoryGetCounters()
+{
+	return gMemoryCounters;
+}
+
+void memoryAddCounters(const MemoryCounters& counters)
+{
+	gMemoryCounters.allocations += counters.allocations;
+	gMemoryCounters.bytes += counters.bytes;
+}
+
+size_t memoryGetPeakRSS()
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024;
+#endif
+}
\ No newline at end of file
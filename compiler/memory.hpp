@@ -0,0 +1,14 @@
+#pragma once
+
+struct MemoryCounters
+{
+	unsigned long long allocations;
+	unsigned long long bytes;
+};
+
+// Returns the total number of allocations made by the calling thread, including the ones attributed to it with memoryAddCounters
+MemoryCounters memoryGetCounters();
+
+void memoryAddCounters(const MemoryCounters& counters);
+
+size_t memoryGetPeakRSS();
\ No newline at end of file
@@ -32,6 +32,15 @@ struct ModuleData
 	unsigned int index;
 
 	vector<pair<Str, Location>> imports;
+
+	// modules that import this one
+	vector<ModuleData*> dependents;
+
+	// number of imports that the module is still waiting for
+	unsigned int pending;
+
+	// dependents no longer wait for the module once it's sorted or once it breaks a circular dependency
+	bool released;
 };
 
 static pair<Str, Location> findCircularDependencyRec(const pair<Str, Location>& import, const unordered_map<Str, ModuleData>& modules, unordered_set<Str>& visited)
@@ -46,6 +55,12 @@ static pair<Str, Location> findCircularDependencyRec(const pair<Str, Location>&
 
 	for (auto& i: it->second.imports)
 	{
+		auto mi = modules.find(i.first);
+		assert(mi != modules.end());
+
+		if (mi->second.released)
+			continue;
+
 		auto im = findCircularDependencyRec(i, modules, visited);
 		if (im.first.size)
 			return im;
@@ -63,65 +78,87 @@ static pair<Str, Location> findCircularDependency(const pair<Str, Location>& imp
 	return findCircularDependencyRec(import, modules, visited);
 }
 
-static bool moduleIsReady(const ModuleData& module, const unordered_set<Str>& visited)
+static void moduleRelease(ModuleData& module, vector<ModuleData*>& ready)
 {
-	for (auto& i: module.imports)
-		if (visited.count(i.first) == 0)
-			return false;
+	assert(!module.released);
+	module.released = true;
+
+	for (ModuleData* d: module.dependents)
+	{
+		assert(d->pending > 0);
 
-	return true;
+		if (--d->pending == 0)
+			ready.push_back(d);
+	}
 }
 
-static vector<unsigned int> moduleSort(Output& output, const unordered_map<Str, ModuleData>& modules)
+// Kahn's algorithm; every level contains the modules whose imports are all in the previous levels
+static vector<vector<unsigned int>> moduleSort(Output& output, unordered_map<Str, ModuleData>& modules)
 {
-	vector<unsigned int> result;
-
-	vector<const ModuleData*> pending;
+	vector<ModuleData*> sorted;
 	for (auto& m: modules)
-		pending.push_back(&m.second);
+		sorted.push_back(&m.second);
 
 	// make sure output order is stable
-	sort(pending.begin(), pending.end(), [](const ModuleData* lhs, const ModuleData* rhs) { return lhs->name < rhs->name; });
-
-	unordered_set<Str> visited;
-
-	while (!pending.empty())
-	{
-		size_t write = 0;
+	sort(sorted.begin(), sorted.end(), [](const ModuleData* lhs, const ModuleData* rhs) { return lhs->name < rhs->name; });
 
-		for (size_t i = 0; i < pending.size(); ++i)
+	for (ModuleData* m: sorted)
+		for (auto& i: m->imports)
 		{
-			const ModuleData* m = pending[i];
-
-			if (moduleIsReady(*m, visited))
-			{
-				result.push_back(m->index);
-				visited.insert(m->name);
-			}
-			else
-			{
-				pending[write++] = m;
-			}
+			auto it = modules.find(i.first);
+			assert(it != modules.end());
+
+			it->second.dependents.push_back(m);
+			m->pending++;
 		}
 
-		if (write == pending.size())
+	vector<ModuleData*> ready;
+
+	for (ModuleData* m: sorted)
+		if (m->pending == 0)
+			ready.push_back(m);
+
+	vector<vector<unsigned int>> result;
+	size_t count = 0;
+
+	while (count < sorted.size())
+	{
+		if (ready.empty())
 		{
-			auto import = findCircularDependency(make_pair(pending[0]->name, Location()), modules);
+			auto first = find_if(sorted.begin(), sorted.end(), [](const ModuleData* m) { return !m->released; });
+			assert(first != sorted.end());
+
+			auto import = findCircularDependency(make_pair((*first)->name, Location()), modules);
 			assert(import.first.size);
 
 			output.error(import.second, "Circular dependency detected: module %s transitively imports itself", import.first.str().c_str());
 
 			// break the cycle to proceed with the sorting
-			visited.insert(import.first);
+			moduleRelease(modules[import.first], ready);
+			continue;
 		}
 
-		pending.resize(write);
+		sort(ready.begin(), ready.end(), [](const ModuleData* lhs, const ModuleData* rhs) { return lhs->name < rhs->name; });
+
+		vector<ModuleData*> level;
+		level.swap(ready);
+
+		result.emplace_back();
+
+		for (ModuleData* m: level)
+		{
+			result.back().push_back(m->index);
+			count++;
+
+			if (!m->released)
+				moduleRelease(*m, ready);
+		}
 	}
 
 	return result;
 }
 
-vector<unsigned int> moduleSort(Output& output, const vector<Ast*>& modules)
+vector<vector<unsigned int>> moduleSort(Output& output, const vector<Ast*>& modules)
 {
 	unordered_map<Str, ModuleData> moduleMap;
 
@@ -141,7 +178,7 @@ vector<unsigned int> moduleSort(Output& output, const vector<Ast*>& modules)
 		vector<pair<Str, Location>> imports;
 		moduleGatherImports(root, [&](Str name, Location location) { imports.push_back(make_pair(name, location)); });
 
-		moduleMap[m->name] = { m->name, unsigned(i), imports };
+		moduleMap[m->name] = { m->name, unsigned(i), imports, {}, 0, false };
 	}
 
 	return moduleSort(output, moduleMap);
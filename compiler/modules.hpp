@@ -7,8 +7,15 @@ struct Ast;
 struct ModuleResolver
 {
 	function<Ast* (Str)> lookup;
+
+	// makes top-level variables of imported modules visible to the importer; used by the REPL where each entry is a module
+	bool exportVariables = false;
+
+	// functions of the importer replace imported functions with the same name and argument types
+	bool shadowImports = false;
 };
 
 void moduleGatherImports(Ast* root, function<void (Str, Location)> f);
 
-vector<unsigned int> moduleSort(Output& output, const vector<Ast*>& modules);
\ No newline at end of file
+// Returns the modules in dependency order, grouped into levels; modules of the same level don't import each other
+vector<vector<unsigned int>> moduleSort(Output& output, const vector<Ast*>& modules);
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "common.hpp"
 #include "output.hpp"
 
+#include "source.hpp"
+
 #include <stdarg.h>
 
 static pair<size_t, size_t> findLine(const Str& data, size_t offset)
@@ -37,29 +39,29 @@ static void strprintf(string& result, const char* format, ...)
 
 static string print(Output* output, Location loc, const char* format, va_list args)
 {
+	SourcePosition pos = sourceResolve(loc);
+
 	string result;
 
-	strprintf(result, "%s(%d,%d): ", loc.source, loc.line + 1, loc.column + 1);
+	strprintf(result, "%s(%d,%d): ", pos.source, pos.line + 1, pos.column + 1);
 	strprintfv(result, format, args);
 	result.append("\n");
 
-	auto it = output->sources.find(loc.source);
-
-	if (it != output->sources.end())
+	if (pos.contents.data)
 	{
-		Str contents = it->second;
+		Str contents = pos.contents;
 
-		assert(loc.offset + loc.length <= contents.size);
+		assert(pos.offset + pos.length <= contents.size);
 
-		auto line = findLine(contents, loc.offset);
+		auto line = findLine(contents, pos.offset);
 
 		result.append("\n\t");
 		result.append(contents.data + line.first, line.second - line.first);
 
 		result.append("\n\t");
-		result.append(loc.offset - line.first, ' ');
+		result.append(pos.offset - line.first, ' ');
 
-		result.append(max(size_t(1), min(loc.length, line.second - loc.offset)), '^');
+		result.append(max(size_t(1), min(pos.length, line.second - pos.offset)), '^');
 
 		result.append("\n");
 	}
@@ -84,6 +86,9 @@ void Output::panic(Location loc, const char* format, ...)
 	messages.push_back(print(this, loc, format, args));
 	va_end(args);
 
+	if (panicHandler)
+		panicHandler(loc);
+
 	flush();
 	exit(1);
 }
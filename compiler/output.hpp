@@ -5,11 +5,13 @@
 
 struct Output
 {
-	unordered_map<const char*, Str> sources;
 	vector<string> messages;
 	int errors = 0;
 	int warnings = 0;
 
+	// Called by panic() instead of terminating the process; must not return
+	function<void (const Location&)> panicHandler;
+
 	ATTR_NORETURN ATTR_PRINTF(3, 4) void panic(Location loc, const char* format, ...);
 
 	ATTR_PRINTF(3, 4) void error(Location loc, const char* format, ...);
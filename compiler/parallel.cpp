@@ -0,0 +1,106 @@
+#include "common.hpp"
+#include "parallel.hpp"
+
+#include "memory.hpp"
+
+#include <atomic>
+
+static void workerThread(ThreadPool* pool)
+{
+	unique_lock<mutex> l(pool->lock);
+
+	for (;;)
+	{
+		pool->jobReady.wait(l, [&]() { return pool->exiting || !pool->jobs.empty(); });
+
+		if (pool->jobs.empty())
+			break;
+
+		function<void ()> job = move(pool->jobs.front());
+		pool->jobs.pop_front();
+
+		l.unlock();
+
+		job();
+
+		l.lock();
+
+		if (--pool->pending == 0)
+			pool->jobDone.notify_all();
+	}
+}
+
+ThreadPool::ThreadPool(unsigned int threads): pending(0), exiting(false)
+{
+	for (unsigned int i = 0; i < threads; ++i)
+		this->threads.emplace_back(workerThread, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> l(lock);
+		exiting = true;
+	}
+
+	jobReady.notify_all();
+
+	for (auto& t: threads)
+		t.join();
+}
+
+void ThreadPool::push(function<void ()> job)
+{
+	if (threads.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		lock_guard<mutex> l(lock);
+
+		jobs.push_back(move(job));
+		pending++;
+	}
+
+	jobReady.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	unique_lock<mutex> l(lock);
+
+	jobDone.wait(l, [&]() { return pending == 0; });
+}
+
+unsigned int ThreadPool::getDefaultThreads()
+{
+	unsigned int result = thread::hardware_concurrency();
+
+	return result == 0 ? 1 : result;
+}
+
+void parallelFor(ThreadPool& pool, size_t count, const function<void (size_t)>& f)
+{
+	// allocations made by the jobs on worker threads are attributed to the calling thread
+	atomic<unsigned long long> allocations(0);
+	atomic<unsigned long long> bytes(0);
+
+	for (size_t i = 0; i < count; ++i)
+		pool.push([&, i]() {
+			MemoryCounters start = memoryGetCounters();
+
+			f(i);
+
+			MemoryCounters end = memoryGetCounters();
+
+			allocations += end.allocations - start.allocations;
+			bytes += end.bytes - start.bytes;
+		});
+
+	pool.wait();
+
+	if (!pool.threads.empty())
+		memoryAddCounters({ allocations, bytes });
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+struct ThreadPool
+{
+	vector<thread> threads;
+
+	mutex lock;
+	condition_variable jobReady;
+	condition_variable jobDone;
+
+	deque<function<void ()>> jobs;
+	size_t pending;
+	bool exiting;
+
+	// threads == 0 makes the pool run all jobs synchronously in push()
+	explicit ThreadPool(unsigned int threads);
+	~ThreadPool();
+
+	void push(function<void ()> job);
+	void wait();
+
+	static unsigned int getDefaultThreads();
+};
+
+void parallelFor(ThreadPool& pool, size_t count, const function<void (size_t)>& f);
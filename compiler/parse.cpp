@@ -4,6 +4,9 @@
 #include "ast.hpp"
 #include "tokenize.hpp"
 #include "output.hpp"
+#include "symbol.hpp"
+#include "visit.hpp"
+#include "source.hpp"
 
 #include <cerrno>
 
@@ -15,9 +18,9 @@ struct TokenStream
 	const Tokens* tokens;
 	size_t index;
 
-	const Token& get(size_t offset = 0) const
+	Token get(size_t offset = 0) const
 	{
-		return index + offset < tokens->tokens.size ? tokens->tokens[index + offset] : kEnd;
+		return index + offset < tokens->size() ? tokens->get(index + offset) : kEnd;
 	}
 
 	void move()
@@ -29,16 +32,12 @@ struct TokenStream
 
 	bool is(Token::Type type)
 	{
-		const Token& t = get();
-
-		return (t.type == type);
+		return index < tokens->size() ? tokens->types[index] == type : type == Token::TypeEnd;
 	}
 
 	bool is(Token::Type type, const char* data)
 	{
-		const Token& t = get();
-
-		return (t.type == type && t.data == data);
+		return is(type) && index < tokens->size() && tokens->data[index] == data;
 	}
 
 	void expect(Token::Type type)
@@ -80,14 +79,29 @@ struct TokenStream
 	}
 };
 
+static const Line& getLine(const TokenStream& ts, const Location& loc)
+{
+	const Arr<Line>& lines = ts.tokens->lines;
+
+	// the end token doesn't have a location and is treated as if it was on the first line
+	size_t offset = loc.offset >= ts.tokens->base ? loc.offset - ts.tokens->base : 0;
+
+	auto it = upper_bound(lines.begin(), lines.end(), offset, [](size_t offset, const Line& line) { return offset < line.offset; });
+	assert(it != lines.begin());
+
+	return *(it - 1);
+}
+
 static int getLineIndent(const TokenStream& ts, const Location& loc)
 {
-	return ts.tokens->lines[loc.line].indent;
+	return getLine(ts, loc).indent;
 }
 
 static bool isFirstOnLine(const TokenStream& ts, const Location& loc)
 {
-	return loc.column == ts.tokens->lines[loc.line].indent;
+	const Line& line = getLine(ts, loc);
+
+	return loc.offset - ts.tokens->base == line.offset + line.indent;
 }
 
 static Arr<Ty*> parseTypeArguments(TokenStream& ts);
@@ -256,11 +270,15 @@ static void parseIndent(TokenStream& ts, const Location* indent, F f)
 
 static Ast* parseExpr(TokenStream& ts);
 
-static Ast* parseBlock(TokenStream& ts, const Location* indent)
+static bool isFnDecl(TokenStream& ts);
+static Ast* parseFnDecl(TokenStream& ts, Tokens* lazyTokens);
+
+// Bodies of functions in the block are deferred if lazyTokens is set; they refer to the tokens when they are parsed later
+static Ast* parseBlock(TokenStream& ts, const Location* indent, Tokens* lazyTokens = nullptr)
 {
 	Arr<Ast*> body;
 
-	parseIndent(ts, indent, [&]() { body.push(parseExpr(ts)); });
+	parseIndent(ts, indent, [&]() { body.push(lazyTokens && isFnDecl(ts) ? parseFnDecl(ts, lazyTokens) : parseExpr(ts)); });
 
 	return UNION_NEW(Ast, Block, { nullptr, Location(), body });
 }
@@ -367,7 +385,7 @@ static pair<Ty*, Arr<Variable*>> parseFnSignature(TokenStream& ts)
 
 		Ty* type = parseTypeAscription(ts);
 
-		args.push(new Variable { Variable::KindArgument, argname.data, type, argname.location });
+		args.push(ARENA_NEW(Variable) { Variable::KindArgument, argname.data, type, argname.location });
 		argtys.push(type);
 
 		if (!ts.is(Token::TypeBracket, ")"))
@@ -393,7 +411,7 @@ static Ast* parseFn(TokenStream& ts)
 
 	Ast* body = parseBlockExpr(ts, &start);
 
-	Variable* var = new Variable { Variable::KindFunction, Str(), sig.first, start };
+	Variable* var = ARENA_NEW(Variable) { Variable::KindFunction, Str(), sig.first, start };
 	Ast* decl = UNION_NEW(Ast, FnDecl, { nullptr, start, var, Arr<Ty*>(), sig.second, 0, body });
 
 	return UNION_NEW(Ast, Fn, { nullptr, start, int(ts.index), decl });
@@ -415,7 +433,60 @@ static Ast* parseFnBody(TokenStream& ts, const Location* indent)
 	return parseBlock(ts, indent);
 }
 
-static Ast* parseFnDecl(TokenStream& ts)
+static bool isSignatureComplete(Ty* type)
+{
+	bool result = true;
+
+	visitType(type, [&](Ty* ty) { result &= ty->kind != Ty::KindUnknown; });
+
+	return result;
+}
+
+// Finds the end of the function body the same way parseFnBody does, without building the AST
+static LazyBody* skipFnBody(TokenStream& ts, Tokens* tokens, const Location& indent)
+{
+	size_t begin = ts.index;
+
+	ts.eat(Token::TypeLine);
+
+	if (ts.is(Token::TypeIdent, "llvm"))
+	{
+		ts.move();
+		ts.eat(Token::TypeString);
+	}
+	else
+	{
+		int startIndent = getLineIndent(ts, indent);
+		int firstIndent = getLineIndent(ts, ts.get().location);
+
+		if (firstIndent <= startIndent)
+			ts.output->panic(ts.get().location, "Invalid indentation: expected >%d, got %d", startIndent, firstIndent);
+
+		// newlines inside brackets don't end the body
+		int depth = 0;
+
+		while (!ts.is(Token::TypeEnd))
+		{
+			if (ts.is(Token::TypeBracket))
+			{
+				char ch = ts.tokens->data[ts.index][0];
+
+				depth += (ch == '(' || ch == '[' || ch == '{') ? 1 : -1;
+			}
+			else if (depth == 0 && ts.is(Token::TypeLine) && getLineIndent(ts, ts.get(1).location) <= startIndent)
+			{
+				ts.move();
+				break;
+			}
+
+			ts.move();
+		}
+	}
+
+	return ARENA_NEW(LazyBody) { tokens, begin, ts.index, indent };
+}
+
+static Ast* parseFnDecl(TokenStream& ts, Tokens* lazyTokens)
 {
 	Location indent = ts.get().location;
 
@@ -448,10 +519,14 @@ static Ast* parseFnDecl(TokenStream& ts)
 	auto tysig = parseTypeSignature(ts);
 	auto sig = parseFnSignature(ts);
 
-	Ast* body = bodyImplicit ? nullptr : parseFnBody(ts, &indent);
+	// if the signature doesn't depend on the body, the body can be parsed when it's needed
+	bool bodyLazy = !bodyImplicit && lazyTokens && isSignatureComplete(sig.first);
 
-	Variable* var = new Variable { Variable::KindFunction, name.data, sig.first, name.location };
-	Ast* result = UNION_NEW(Ast, FnDecl, { nullptr, Location(), var, tysig, sig.second, attributes, body });
+	LazyBody* lazyBody = bodyLazy ? skipFnBody(ts, lazyTokens, indent) : nullptr;
+	Ast* body = (bodyImplicit || bodyLazy) ? nullptr : parseFnBody(ts, &indent);
+
+	Variable* var = ARENA_NEW(Variable) { Variable::KindFunction, name.data, sig.first, name.location };
+	Ast* result = UNION_NEW(Ast, FnDecl, { nullptr, Location(), var, tysig, sig.second, attributes, body, nullptr, nullptr, lazyBody });
 
 	var->fn = result;
 
@@ -470,7 +545,7 @@ static Ast* parseVarDecl(TokenStream& ts)
 
 	Ast* expr = parseExpr(ts);
 
-	return UNION_NEW(Ast, VarDecl, { nullptr, Location(), new Variable { Variable::KindVariable, name.data, type, name.location }, expr });
+	return UNION_NEW(Ast, VarDecl, { nullptr, Location(), ARENA_NEW(Variable) { Variable::KindVariable, name.data, type, name.location }, expr });
 }
 
 static Ast* parseStructDecl(TokenStream& ts)
@@ -532,7 +607,7 @@ static Ast* parseImport(TokenStream& ts)
 	string path = start.data.str();
 	Location location = start.location;
 
-	while (ts.is(Token::TypeAtom, ".") && ts.get().location.line == location.line)
+	while (ts.is(Token::TypeAtom, ".") && &getLine(ts, ts.get().location) == &getLine(ts, location))
 	{
 		ts.move();
 
@@ -543,7 +618,7 @@ static Ast* parseImport(TokenStream& ts)
 		location = Location(location, name.location);
 	}
 
-	return UNION_NEW(Ast, Import, { nullptr, location, Str::copy(path.c_str()) });
+	return UNION_NEW(Ast, Import, { nullptr, location, symbolIntern(Str::copy(path.c_str())) });
 }
 
 static Ast* parseCall(TokenStream& ts, Ast* expr, Location start, Ast* self = nullptr)
@@ -659,7 +734,7 @@ static Ast* parseFor(TokenStream& ts)
 	ts.eat(Token::TypeIdent, "for");
 
 	auto name = ts.eat(Token::TypeIdent);
-	Variable* var = new Variable { Variable::KindVariable, name.data, UNION_NEW(Ty, Unknown, {}), name.location };
+	Variable* var = ARENA_NEW(Variable) { Variable::KindVariable, name.data, UNION_NEW(Ty, Unknown, {}), name.location };
 
 	Variable* index = nullptr;
 
@@ -668,7 +743,7 @@ static Ast* parseFor(TokenStream& ts)
 		ts.move();
 
 		auto name = ts.eat(Token::TypeIdent);
-		index = new Variable { Variable::KindValue, name.data, UNION_NEW(Ty, Unknown, {}), name.location };
+		index = ARENA_NEW(Variable) { Variable::KindValue, name.data, UNION_NEW(Ty, Unknown, {}), name.location };
 	}
 
 	ts.eat(Token::TypeIdent, "in");
@@ -951,10 +1026,10 @@ static Ast* parsePrimary(TokenStream& ts)
 	}
 
 	if (ts.is(Token::TypeIdent, "extern") || ts.is(Token::TypeIdent, "builtin") || ts.is(Token::TypeIdent, "inline"))
-		return parseFnDecl(ts);
+		return parseFnDecl(ts, nullptr);
 
 	if (ts.is(Token::TypeIdent, "fn"))
-		return ts.get(1).type == Token::TypeIdent ? parseFnDecl(ts) : parseFn(ts);
+		return ts.get(1).type == Token::TypeIdent ? parseFnDecl(ts, nullptr) : parseFn(ts);
 
 	if (ts.is(Token::TypeIdent, "var"))
 		return parseVarDecl(ts);
@@ -1031,23 +1106,61 @@ Ast* parseExpr(TokenStream& ts)
 	return parseExprClimb(ts, parsePrimary(ts), 0);
 }
 
-Ast* parse(Output& output, const Tokens& tokens)
+static bool isFnDecl(TokenStream& ts)
 {
-	TokenStream ts = { &output, &tokens, 0 };
+	if (ts.is(Token::TypeIdent, "extern") || ts.is(Token::TypeIdent, "builtin") || ts.is(Token::TypeIdent, "inline"))
+		return true;
+
+	return ts.is(Token::TypeIdent, "fn") && ts.get(1).type == Token::TypeIdent;
+}
 
-	Ast* result = parseBlock(ts, nullptr);
+static Ast* parseTopLevel(Output& output, const Tokens& tokens, Tokens* lazyTokens)
+{
+	TokenStream ts = { &output, lazyTokens ? lazyTokens : &tokens, 0 };
+
+	// only top-level functions are deferred since their scope can be reconstructed from the module
+	Ast* result = parseBlock(ts, nullptr, lazyTokens);
 
 	ts.expect(Token::TypeEnd);
 
 	return result;
 }
 
-Ast* parse(Output& output, const Tokens& tokens, const Str& moduleName)
+Ast* parse(Output& output, const Tokens& tokens)
+{
+	return parseTopLevel(output, tokens, nullptr);
+}
+
+Ast* parse(Output& output, const Tokens& tokens, const Str& moduleName, bool lazyBodies)
 {
-	Ast* result = parse(output, tokens);
+	// lazy bodies keep referring to the tokens after parsing
+	Tokens* lazyTokens = lazyBodies ? ARENA_NEW(Tokens)(tokens) : nullptr;
+
+	Ast* result = parseTopLevel(output, tokens, lazyTokens);
 
-	if (tokens.tokens.size == 0)
+	if (tokens.size() == 0)
 		return result;
 
-	return UNION_NEW(Ast, Module, { nullptr, tokens.tokens[0].location, moduleName, result });
+	return UNION_NEW(Ast, Module, { nullptr, tokens.locations[0], moduleName, result });
+}
+
+void parseLazyBody(Output& output, Ast* decl)
+{
+	UNION_CASE(FnDecl, n, decl);
+	assert(n && n->lazy);
+
+	// bodies loaded from interface files get the tokens when the first body of the module is parsed
+	if (n->lazy->tokens->size() == 0)
+	{
+		SourcePosition pos = sourceResolve(n->lazy->indent);
+
+		*n->lazy->tokens = tokenize(output, pos.source, pos.contents);
+	}
+
+	TokenStream ts = { &output, n->lazy->tokens, n->lazy->begin };
+
+	n->body = parseFnBody(ts, &n->lazy->indent);
+	assert(ts.index == n->lazy->end);
+
+	n->lazy = nullptr;
 }
\ No newline at end of file
@@ -5,4 +5,7 @@ struct Tokens;
 struct Output;
 
 Ast* parse(Output& output, const Tokens& tokens);
-Ast* parse(Output& output, const Tokens& tokens, const Str& moduleName);
\ No newline at end of file
+Ast* parse(Output& output, const Tokens& tokens, const Str& moduleName, bool lazyBodies = false);
+
+// Parses the body of a function that was deferred by the module parse
+void parseLazyBody(Output& output, Ast* decl);
\ No newline at end of file
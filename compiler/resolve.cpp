@@ -5,6 +5,8 @@
 #include "modules.hpp"
 #include "visit.hpp"
 #include "output.hpp"
+#include "parse.hpp"
+#include "symbol.hpp"
 
 #include <cerrno>
 
@@ -18,21 +20,27 @@ struct NameMap
 		Binding* shadow;
 	};
 
-	unordered_map<Str, Binding*> data;
+	// bindings are indexed by symbol id
+	vector<Binding*> data;
 	vector<Binding*> stack;
 
+	Binding* lookup(const Str& name) const
+	{
+		unsigned int symbol = symbolGet(name);
+
+		return symbol < data.size() ? data[symbol] : nullptr;
+	}
+
 	T* find(const Str& name) const
 	{
-		auto it = data.find(name);
+		Binding* binding = lookup(name);
 
-		return (it != data.end() && it->second) ? it->second->value : nullptr;
+		return binding ? binding->value : nullptr;
 	}
 
 	vector<T*> findAll(const Str& name) const
 	{
-		auto it = data.find(name);
-
-		Binding* binding = (it != data.end()) ? it->second : nullptr;
+		Binding* binding = lookup(name);
 
 		vector<T*> result;
 
@@ -48,8 +56,13 @@ struct NameMap
 
 	void push(const Str& name, T* value)
 	{
-		Binding*& binding = data[name];
-		binding = new Binding { name, value, binding };
+		unsigned int symbol = symbolGet(name);
+
+		if (symbol >= data.size())
+			data.resize(symbol + 1);
+
+		Binding*& binding = data[symbol];
+		binding = ARENA_NEW(Binding) { symbolIntern(name), value, binding };
 
 		stack.push_back(binding);
 	}
@@ -62,7 +75,7 @@ struct NameMap
 		{
 			Binding* b = stack.back();
 
-			data[b->name] = b->shadow;
+			data[b->name.symbol] = b->shadow;
 
 			stack.pop_back();
 		}
@@ -141,7 +154,13 @@ static void resolveImport(ResolveNames& rs, Ast* root)
 	assert(bn);
 
 	for (auto& c: bn->body)
+	{
 		resolveDecl(rs, c);
+
+		if (UNION_CASE(VarDecl, n, c))
+			if (rs.moduleResolver->exportVariables)
+				rs.variables.push(n->var->name, n->var);
+	}
 }
 
 static void resolveImport(ResolveNames& rs, const Str& name)
@@ -154,7 +173,82 @@ static void resolveImport(ResolveNames& rs, const Str& name)
 	resolveImport(rs, import);
 }
 
-static Arr<Variable*> resolveBindings(const vector<Variable*>& targets)
+static bool isSignatureResolved(Ty* type)
+{
+	bool result = true;
+
+	visitType(type, [&](Ty* ty) {
+		if (UNION_CASE(Instance, t, ty))
+			result &= t->def || t->generic;
+	});
+
+	return result;
+}
+
+// Arguments that aren't annotated match any type; generic arguments are matched by position
+static bool isSameSignature(Ast::FnDecl* lhs, Ast::FnDecl* rhs)
+{
+	if (lhs->tyargs.size != rhs->tyargs.size)
+		return false;
+
+	if (!isSignatureResolved(lhs->var->type) || !isSignatureResolved(rhs->var->type))
+		return false;
+
+	Ty* type = typeInstantiate(lhs->var->type, [&](Ty* generic) -> Ty* {
+		for (size_t i = 0; i < lhs->tyargs.size; ++i)
+			if (lhs->tyargs[i] == generic)
+			{
+				UNION_CASE(Generic, g, rhs->tyargs[i]);
+				assert(g);
+
+				return UNION_NEW(Ty, Instance, { g->name, g->location, Arr<Ty*>(), nullptr, rhs->tyargs[i] });
+			}
+
+		return nullptr;
+	});
+
+	UNION_CASE(Function, lf, type);
+	UNION_CASE(Function, rf, rhs->var->type);
+	assert(lf && rf);
+
+	if (lf->args.size != rf->args.size || lf->varargs != rf->varargs)
+		return false;
+
+	TypeConstraints constraints;
+	constraints.transient = true;
+
+	for (size_t i = 0; i < lf->args.size; ++i)
+		if (!typeUnify(lf->args[i], rf->args[i], &constraints))
+			return false;
+
+	return true;
+}
+
+// The REPL compiles every entry as a module; redefining a function in a later entry replaces the earlier definition
+static bool isShadowed(ResolveNames& rs, Variable* var, const Arr<Variable*>& newer)
+{
+	if (!rs.moduleResolver || !rs.moduleResolver->shadowImports)
+		return false;
+
+	UNION_CASE(FnDecl, decl, var->fn);
+	assert(decl);
+
+	// functions that haven't been visited yet are declared in the module that is being resolved
+	Ast::Module* module = decl->module ? decl->module : rs.module;
+
+	for (Variable* nv: newer)
+	{
+		UNION_CASE(FnDecl, nd, nv->fn);
+		assert(nd);
+
+		if ((nd->module ? nd->module : rs.module) != module && isSameSignature(nd, decl))
+			return true;
+	}
+
+	return false;
+}
+
+static Arr<Variable*> resolveBindings(ResolveNames& rs, const vector<Variable*>& targets)
 {
 	if (targets.empty())
 		return {};
@@ -164,9 +258,83 @@ static Arr<Variable*> resolveBindings(const vector<Variable*>& targets)
 
 	Arr<Variable*> result;
 
+	// targets are ordered from the most recent binding, so newer functions are added first
 	for (Variable* var: targets)
-		if (var->kind == Variable::KindFunction)
+		if (var->kind == Variable::KindFunction && !isShadowed(rs, var, result))
+			result.push(var);
+
+	return result;
+}
+
+// Literals determine the argument type before typechecking, which is enough to reject most overloads
+static bool isLiteralCompatible(Ty* type, Ast* node)
+{
+	if (type->kind == Ty::KindUnknown || type->kind == Ty::KindGeneric)
+		return true;
+
+	// instances of generic arguments can be substituted with any type
+	UNION_CASE(Instance, t, type);
+
+	if (t && !t->def)
+		return true;
+
+	switch (node->kind)
+	{
+	case Ast::KindLiteralVoid: return type->kind == Ty::KindVoid;
+	case Ast::KindLiteralBool: return type->kind == Ty::KindBool;
+	case Ast::KindLiteralInteger: return type->kind == Ty::KindInteger;
+	case Ast::KindLiteralFloat: return type->kind == Ty::KindFloat;
+	case Ast::KindLiteralString: return type->kind == Ty::KindString;
+
+	case Ast::KindLiteralStruct:
+		if (UNION_CASE(Instance, lt, astType(node)))
+			return t && (!lt->def || t->def == lt->def);
+
+		return true;
+
+	default:
+		return true;
+	}
+}
+
+// Overloads that can't accept the argument count or the literal arguments are discarded before typechecking;
+// if no candidates remain, the set is left as is so that the typechecker reports the error
+static void resolveCallTargets(Ast::Ident* ident, const Arr<Ast*>& args)
+{
+	Arr<Variable*> result;
+
+	for (Variable* var: ident->targets)
+	{
+		UNION_CASE(Function, fnty, var->type);
+		assert(fnty);
+
+		if (fnty->varargs ? fnty->args.size > args.size : fnty->args.size != args.size)
+			continue;
+
+		bool compatible = true;
+
+		for (size_t i = 0; i < fnty->args.size && compatible; ++i)
+			compatible = isLiteralCompatible(fnty->args[i], args[i]);
+
+		if (compatible)
 			result.push(var);
+	}
+
+	if (result.size > 0 && result.size < ident->targets.size)
+		ident->targets = result;
+}
+
+// Type arguments omitted from struct types in the signature are inferred from the function body
+static bool isSignatureInferred(Ty* type)
+{
+	bool result = false;
+
+	visitType(type, [&](Ty* ty) {
+		if (UNION_CASE(Instance, t, ty))
+			if (t->def && t->tyargs.size == 0)
+				if (UNION_CASE(Struct, def, t->def))
+					result |= def->tyargs.size != 0;
+	});
 
 	return result;
 }
@@ -179,7 +347,7 @@ static bool resolveNamesNode(ResolveNames& rs, Ast* root)
 
 	if (UNION_CASE(Ident, n, root))
 	{
-		n->targets = resolveBindings(rs.variables.findAll(n->name));
+		n->targets = resolveBindings(rs, rs.variables.findAll(n->name));
 
 		if (n->targets.size == 0)
 			rs.output->error(n->location, "Unresolved identifier %s", n->name.str().c_str());
@@ -239,6 +407,9 @@ static bool resolveNamesNode(ResolveNames& rs, Ast* root)
 
 		visitAstTypes(root, resolveType, rs);
 
+		if (n->lazy && isSignatureInferred(n->var->type))
+			parseLazyBody(*rs.output, root);
+
 		if (n->body)
 		{
 			for (auto& a: n->args)
@@ -275,6 +446,14 @@ static bool resolveNamesNode(ResolveNames& rs, Ast* root)
 
 		rs.pop(scope);
 	}
+	else if (UNION_CASE(Call, n, root))
+	{
+		visitAstInner(root, resolveNamesNode, rs);
+
+		if (UNION_CASE(Ident, ne, n->expr))
+			if (ne->targets.size > 1)
+				resolveCallTargets(ne, n->args);
+	}
 	else if (UNION_CASE(VarDecl, n, root))
 	{
 		visitAstInner(root, resolveNamesNode, rs);
@@ -298,12 +477,38 @@ void resolveNames(Output& output, Ast* root, ModuleResolver* moduleResolver)
 	visitAst(root, resolveNamesNode, rs);
 }
 
-struct ResolveMembers
+void resolveFunctionBody(Output& output, Ast* decl, ModuleResolver* moduleResolver)
 {
-	Output* output;
+	UNION_CASE(FnDecl, fn, decl);
+	assert(fn && fn->module && !fn->parent);
 
-	int counter;
-};
+	UNION_CASE(Block, block, fn->module->body);
+	assert(block);
+
+	ResolveNames rs = { &output, moduleResolver };
+
+	rs.module = fn->module;
+
+	// Reconstruct the module scope at the point of the declaration in the same order resolveNamesNode builds it
+	for (auto& i: fn->module->autoimports)
+		resolveImport(rs, i);
+
+	for (auto& c: block->body)
+		resolveDecl(rs, c);
+
+	for (auto& c: block->body)
+	{
+		if (c == decl)
+			break;
+
+		if (UNION_CASE(VarDecl, n, c))
+			rs.variables.push(n->var->name, n->var);
+		else if (UNION_CASE(Import, n, c))
+			resolveImport(rs, n->name);
+	}
+
+	resolveNamesNode(rs, decl);
+}
 
 static int findMember(Ty* type, const Str& name)
 {
@@ -358,27 +563,20 @@ static bool resolveFieldRef(Output* output, FieldRef& f, Ty* ty)
 	return false;
 }
 
-static bool resolveMembersNode(ResolveMembers& rs, Ast* root)
+int resolveMemberRefs(Output& output, Ast* node)
 {
-	if (UNION_CASE(Member, n, root))
+	int counter = 0;
+
+	if (UNION_CASE(Member, n, node))
 	{
 		if (Ty* type = astType(n->expr))
-			rs.counter += resolveFieldRef(rs.output, n->field, type);
+			counter += resolveFieldRef(&output, n->field, type);
 	}
-	else if (UNION_CASE(LiteralStruct, n, root))
+	else if (UNION_CASE(LiteralStruct, n, node))
 	{
 		for (auto& f: n->fields)
-			rs.counter += resolveFieldRef(rs.output, f.first, n->type);
+			counter += resolveFieldRef(&output, f.first, n->type);
 	}
 
-	return false;
-}
-
-int resolveMembers(Output& output, Ast* root)
-{
-	ResolveMembers rs = { &output };
-
-	visitAst(root, resolveMembersNode, rs);
-
-	return rs.counter;
+	return counter;
 }
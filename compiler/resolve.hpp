@@ -5,4 +5,9 @@ struct Ast;
 struct ModuleResolver;
 
 void resolveNames(Output& output, Ast* root, ModuleResolver* moduleResolver);
-int resolveMembers(Output& output, Ast* root);
+
+// Resolves the body of a top-level function that was parsed after its module has been resolved
+void resolveFunctionBody(Output& output, Ast* decl, ModuleResolver* moduleResolver);
+
+// Resolves member references of a single node without visiting its children; returns the number of resolved references
+int resolveMemberRefs(Output& output, Ast* node);
@@ -0,0 +1,264 @@
+#include "common.hpp"
+#include "server.hpp"
+
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Request: argument count, arguments and working directory as length-prefixed strings; stdout and stderr of
+// the client are passed along with the request so that the output goes directly to the client's terminal.
+// Response: exit code.
+
+static bool sendAll(int fd, const void* data, size_t size)
+{
+	const char* ptr = static_cast<const char*>(data);
+
+	while (size > 0)
+	{
+		ssize_t rc = send(fd, ptr, size, 0);
+		if (rc <= 0) return false;
+
+		ptr += rc;
+		size -= rc;
+	}
+
+	return true;
+}
+
+static bool recvAll(int fd, void* data, size_t size)
+{
+	char* ptr = static_cast<char*>(data);
+
+	while (size > 0)
+	{
+		ssize_t rc = recv(fd, ptr, size, 0);
+		if (rc <= 0) return false;
+
+		ptr += rc;
+		size -= rc;
+	}
+
+	return true;
+}
+
+static void writeString(string& data, const string& value)
+{
+	unsigned int size = value.size();
+
+	data.append(reinterpret_cast<const char*>(&size), sizeof(size));
+	data.append(value);
+}
+
+static bool recvString(int fd, string& value)
+{
+	unsigned int size;
+	if (!recvAll(fd, &size, sizeof(size)))
+		return false;
+
+	value.resize(size);
+
+	return recvAll(fd, &value[0], size);
+}
+
+static bool sendFds(int fd, const int* fds, size_t count)
+{
+	char dummy = 0;
+	iovec iov = { &dummy, 1 };
+
+	char control[CMSG_SPACE(sizeof(int) * 2)] = {};
+	assert(count <= 2);
+
+	msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+	return sendmsg(fd, &msg, 0) == 1;
+}
+
+static bool recvFds(int fd, int* fds, size_t count)
+{
+	char dummy;
+	iovec iov = { &dummy, 1 };
+
+	char control[CMSG_SPACE(sizeof(int) * 2)] = {};
+	assert(count <= 2);
+
+	msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+	if (recvmsg(fd, &msg, 0) != 1)
+		return false;
+
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * count))
+		return false;
+
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+
+	return true;
+}
+
+static bool getSocketAddress(const string& socketPath, sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (socketPath.size() >= sizeof(addr.sun_path))
+		return false;
+
+	strcpy(addr.sun_path, socketPath.c_str());
+
+	return true;
+}
+
+static void serveRequest(int conn, const function<int (const vector<string>&)>& compile)
+{
+	int fds[2];
+	if (!recvFds(conn, fds, 2))
+		return;
+
+	unsigned int count;
+	vector<string> args;
+	string cwd;
+
+	bool valid = recvAll(conn, &count, sizeof(count));
+
+	for (unsigned int i = 0; valid && i < count; ++i)
+	{
+		args.emplace_back();
+		valid = recvString(conn, args.back());
+	}
+
+	valid = valid && recvString(conn, cwd);
+
+	if (valid)
+	{
+		pid_t pid = fork();
+
+		if (pid == 0)
+		{
+			int rc = 1;
+
+			if (chdir(cwd.c_str()) == 0)
+			{
+				dup2(fds[0], STDOUT_FILENO);
+				dup2(fds[1], STDERR_FILENO);
+
+				rc = compile(args);
+
+				fflush(stdout);
+				fflush(stderr);
+			}
+
+			sendAll(conn, &rc, sizeof(rc));
+
+			_exit(0);
+		}
+		else if (pid < 0)
+		{
+			int rc = 1;
+			sendAll(conn, &rc, sizeof(rc));
+		}
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int serverRun(const string& socketPath, const function<int (const vector<string>&)>& compile)
+{
+	sockaddr_un addr;
+	if (!getSocketAddress(socketPath, addr))
+		panic("Socket path %s is too long", socketPath.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		panic("Can't create socket: %s", strerror(errno));
+
+	unlink(socketPath.c_str());
+
+	if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0)
+		panic("Can't listen on %s: %s", socketPath.c_str(), strerror(errno));
+
+	// request processes are never waited for
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;)
+	{
+		int conn = accept(fd, nullptr, nullptr);
+
+		if (conn < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			panic("Can't accept connection: %s", strerror(errno));
+		}
+
+		serveRequest(conn, compile);
+
+		close(conn);
+	}
+}
+
+int serverConnect(const string& socketPath, const vector<string>& args)
+{
+	sockaddr_un addr;
+	if (!getSocketAddress(socketPath, addr))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd)))
+	{
+		close(fd);
+		return -1;
+	}
+
+	string request;
+
+	unsigned int count = args.size();
+	request.append(reinterpret_cast<const char*>(&count), sizeof(count));
+
+	for (auto& a: args)
+		writeString(request, a);
+
+	writeString(request, cwd);
+
+	int fds[] = { STDOUT_FILENO, STDERR_FILENO };
+
+	fflush(stdout);
+	fflush(stderr);
+
+	// once the request is sent, the compilation may have produced output so we can't fall back to compiling locally
+	int rc;
+
+	if (!sendFds(fd, fds, 2) || !sendAll(fd, request.data(), request.size()) || !recvAll(fd, &rc, sizeof(rc)))
+		rc = 1;
+
+	close(fd);
+
+	return rc;
+}
\ No newline at end of file
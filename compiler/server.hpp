@@ -0,0 +1,8 @@
+#pragma once
+
+// Listens on a Unix socket and runs compile in a forked process for every request, so that requests start with
+// the state the server has prepared; compile gets the request arguments (excluding the program name)
+int serverRun(const string& socketPath, const function<int (const vector<string>&)>& compile);
+
+// Sends the request to the server and returns the compilation exit code, or -1 if the server isn't available
+int serverConnect(const string& socketPath, const vector<string>& args);
\ No newline at end of file
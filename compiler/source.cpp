@@ -0,0 +1,90 @@
+#include "common.hpp"
+#include "source.hpp"
+
+struct SourceFile
+{
+	const char* source;
+	Str contents;
+
+	unsigned int base;
+
+	// offsets of line starts; built on first use since most sources never need to be resolved
+	vector<unsigned int> lines;
+};
+
+static mutex gSourceLock;
+static vector<SourceFile*> gSourceFiles;
+static unordered_map<const char*, SourceFile*> gSourceIndex;
+
+// offset 0 is reserved for empty locations
+static size_t gSourceNextBase = 1;
+
+unsigned int sourceRegister(const char* source, const Str& contents)
+{
+	lock_guard<mutex> l(gSourceLock);
+
+	auto it = gSourceIndex.find(source);
+
+	if (it != gSourceIndex.end())
+	{
+		assert(it->second->contents.data == contents.data && it->second->contents.size == contents.size);
+		return it->second->base;
+	}
+
+	// the end of the source is a valid location so each source takes one extra offset
+	size_t base = gSourceNextBase;
+
+	if (base + contents.size + 1 > ~0u)
+		panic("Source files are too large: total size of all sources exceeds 4 GB");
+
+	gSourceNextBase += contents.size + 1;
+
+	SourceFile* file = new SourceFile { source, contents, unsigned(base) };
+
+	gSourceFiles.push_back(file);
+	gSourceIndex[source] = file;
+
+	return file->base;
+}
+
+unsigned int sourceGetBase(const char* source)
+{
+	lock_guard<mutex> l(gSourceLock);
+
+	auto it = gSourceIndex.find(source);
+
+	return it == gSourceIndex.end() ? 0 : it->second->base;
+}
+
+static void buildLines(SourceFile* file)
+{
+	file->lines.push_back(0);
+
+	for (size_t i = 0; i < file->contents.size; ++i)
+		if (file->contents[i] == '\n')
+			file->lines.push_back(i + 1);
+}
+
+SourcePosition sourceResolve(const Location& location)
+{
+	if (location.offset == 0)
+		return { "", Str(), 0, 0, 0, location.length };
+
+	lock_guard<mutex> l(gSourceLock);
+
+	// sources are registered in the order of their base offsets
+	auto it = upper_bound(gSourceFiles.begin(), gSourceFiles.end(), location.offset, [](unsigned int offset, SourceFile* file) { return offset < file->base; });
+	assert(it != gSourceFiles.begin());
+
+	SourceFile* file = *(it - 1);
+
+	size_t offset = location.offset - file->base;
+	assert(offset + location.length <= file->contents.size);
+
+	if (file->lines.empty())
+		buildLines(file);
+
+	auto line = upper_bound(file->lines.begin(), file->lines.end(), offset) - 1;
+
+	return { file->source, file->contents, int(line - file->lines.begin()), int(offset - *line), offset, location.length };
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "location.hpp"
+
+// Location resolved to a position in a source file
+struct SourcePosition
+{
+	const char* source;
+	Str contents;
+
+	int line;
+	int column;
+
+	size_t offset;
+	size_t length;
+};
+
+// Registers the source and returns the base offset of its locations; registering the same source again returns the same base
+unsigned int sourceRegister(const char* source, const Str& contents);
+
+// Returns the base offset of the source or 0 if it hasn't been registered
+unsigned int sourceGetBase(const char* source);
+
+SourcePosition sourceResolve(const Location& location);
\ No newline at end of file
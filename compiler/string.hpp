@@ -3,22 +3,30 @@
 struct Str
 {
 	const char* data;
-	size_t size;
+	unsigned int size;
 
-	Str(): data(0), size(0)
+	// non-zero for interned identifiers (see symbol.hpp)
+	unsigned int symbol;
+
+	Str(): data(0), size(0), symbol(0)
 	{
 	}
 
-	explicit Str(const char* string): data(string), size(strlen(string))
+	explicit Str(const char* string): data(string), size(strlen(string)), symbol(0)
 	{
+		assert(size == strlen(string));
 	}
 
-	Str(const char* data, size_t size): data(data), size(size)
+	Str(const char* data, size_t size): data(data), size(size), symbol(0)
 	{
+		assert(this->size == size);
 	}
 
 	bool operator==(const Str& other) const
 	{
+		if (symbol && other.symbol)
+			return symbol == other.symbol;
+
 		return size == other.size && (size == 0 || memcmp(data, other.data, size) == 0);
 	}
 
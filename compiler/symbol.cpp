@@ -0,0 +1,74 @@
+#include "common.hpp"
+#include "symbol.hpp"
+
+#include <atomic>
+
+// Names are distributed between shards to reduce contention when modules are tokenized in parallel
+struct SymbolShard
+{
+	mutex lock;
+	unordered_map<Str, unsigned int> symbols;
+};
+
+static const size_t kSymbolShards = 64;
+
+static SymbolShard gSymbolShards[kSymbolShards];
+static atomic<unsigned int> gSymbolCount;
+
+// Most lookups hit the per-thread cache and don't need to lock the shard
+static thread_local unordered_map<Str, unsigned int>* gSymbolCache;
+
+static pair<Str, unsigned int> symbolInternShared(const Str& name)
+{
+	SymbolShard& shard = gSymbolShards[std::hash<Str>()(name) % kSymbolShards];
+
+	lock_guard<mutex> l(shard.lock);
+
+	auto it = shard.symbols.find(name);
+
+	if (it != shard.symbols.end())
+		return *it;
+
+	// the table outlives all sources, so the key needs its own copy of the name
+	char* data = new char[name.size];
+	memcpy(data, name.data, name.size);
+
+	Str key(data, name.size);
+	unsigned int symbol = ++gSymbolCount;
+
+	shard.symbols[key] = symbol;
+
+	return make_pair(key, symbol);
+}
+
+Str symbolIntern(const Str& name)
+{
+	if (name.symbol)
+		return name;
+
+	if (!gSymbolCache)
+		gSymbolCache = new unordered_map<Str, unsigned int>();
+
+	Str result = name;
+
+	auto it = gSymbolCache->find(name);
+
+	if (it != gSymbolCache->end())
+	{
+		result.symbol = it->second;
+		return result;
+	}
+
+	auto entry = symbolInternShared(name);
+
+	gSymbolCache->insert(entry);
+
+	result.symbol = entry.second;
+
+	return result;
+}
+
+unsigned int symbolGet(const Str& name)
+{
+	return name.symbol ? name.symbol : symbolIntern(name).symbol;
+}
\ No newline at end of file
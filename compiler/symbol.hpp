@@ -0,0 +1,8 @@
+#pragma once
+
+// Identifiers are interned in a process-wide table that assigns each distinct name a 32-bit symbol id
+// Interned strings keep pointing to the original data, so locations still work; the id is stored in Str::symbol
+Str symbolIntern(const Str& name);
+
+// Returns the symbol id, interning the name if necessary
+unsigned int symbolGet(const Str& name);
\ No newline at end of file
@@ -4,11 +4,16 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LegacyPassManager.h"
 
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/DynamicLibrary.h"
 
 #include <unistd.h>
 #include <fstream>
@@ -75,7 +80,15 @@ string targetHostTriple()
 
 DataLayout targetDataLayout(const string& triple)
 {
-	return createTargetMachine(triple, CodeGenOpt::Default)->createDataLayout();
+	// Creating a target machine is relatively expensive; the compiler server computes the layout for the host triple once
+	static unordered_map<string, DataLayout> cache;
+
+	auto it = cache.find(triple);
+
+	if (it == cache.end())
+		it = cache.insert(make_pair(triple, createTargetMachine(triple, CodeGenOpt::Default)->createDataLayout())).first;
+
+	return it->second;
 }
 
 static string assemble(const string& triple, Module* module, int optimizationLevel, TargetMachine::CodeGenFileType type)
@@ -104,6 +117,83 @@ string targetAssembleText(const string& triple, Module* module, int optimization
 	return assemble(triple, module, optimizationLevel, TargetMachine::CGFT_AssemblyFile);
 }
 
+struct TargetJit
+{
+	int optimizationLevel;
+
+	unique_ptr<ExecutionEngine> engine;
+};
+
+TargetJit* targetJitCreate(const string& runtimePath, int optimizationLevel)
+{
+	string error;
+
+	// JIT-compiled code resolves runtime functions through the process symbol table, which includes all permanently loaded libraries
+	if (sys::DynamicLibrary::LoadLibraryPermanently(runtimePath.c_str(), &error))
+		panic("Error loading runtime %s: %s", runtimePath.c_str(), error.c_str());
+
+	TargetJit* result = new TargetJit();
+	result->optimizationLevel = optimizationLevel;
+
+	return result;
+}
+
+void targetJitDestroy(TargetJit* jit)
+{
+	delete jit;
+}
+
+void targetJitAdd(TargetJit* jit, unique_ptr<Module> module)
+{
+	if (jit->engine)
+	{
+		jit->engine->addModule(move(module));
+		return;
+	}
+
+	string error;
+
+	jit->engine.reset(EngineBuilder(move(module))
+		.setEngineKind(EngineKind::JIT)
+		.setErrorStr(&error)
+		.setOptLevel(getCodeGenOptLevel(jit->optimizationLevel))
+		.setMCJITMemoryManager(unique_ptr<RTDyldMemoryManager>(new SectionMemoryManager()))
+		.create());
+
+	if (!jit->engine)
+		panic("Error creating JIT: %s", error.c_str());
+}
+
+void* targetJitGetFunction(TargetJit* jit, const string& name)
+{
+	assert(jit->engine);
+
+	// MCJIT compiles the modules that were added since the last lookup on demand; symbols that are not defined by
+	// any module are resolved from the runtime
+	if (uint64_t address = jit->engine->getFunctionAddress(name))
+		return reinterpret_cast<void*>(address);
+
+	return sys::DynamicLibrary::SearchForAddressOfSymbol(name);
+}
+
+int targetRun(unique_ptr<Module> module, const string& runtimePath, int optimizationLevel)
+{
+	TargetJit* jit = targetJitCreate(runtimePath, optimizationLevel);
+
+	targetJitAdd(jit, move(module));
+
+	auto main = reinterpret_cast<int (*)()>(targetJitGetFunction(jit, "main"));
+
+	if (!main)
+		panic("Error running program: can't find main");
+
+	int result = main();
+
+	targetJitDestroy(jit);
+
+	return result;
+}
+
 static string targetMakeFolder(const string& outputPath)
 {
 	string outputName = outputPath;
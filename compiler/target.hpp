@@ -16,4 +16,14 @@ llvm::DataLayout targetDataLayout(const string& triple);
 string targetAssembleBinary(const string& triple, llvm::Module* module, int optimizationLevel);
 string targetAssembleText(const string& triple, llvm::Module* module, int optimizationLevel);
 
+struct TargetJit;
+
+TargetJit* targetJitCreate(const string& runtimePath, int optimizationLevel);
+void targetJitDestroy(TargetJit* jit);
+
+void targetJitAdd(TargetJit* jit, unique_ptr<llvm::Module> module);
+void* targetJitGetFunction(TargetJit* jit, const string& name);
+
+int targetRun(unique_ptr<llvm::Module> module, const string& runtimePath, int optimizationLevel);
+
 void targetLink(const string& triple, const string& outputPath, const vector<string>& inputs, const string& runtimePath, bool debugInfo);
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "common.hpp"
 #include "timer.hpp"
 
+#include "memory.hpp"
+
 #include <chrono>
+#include <mutex>
+#include <atomic>
 
 static unsigned long long now()
 {
@@ -10,42 +14,197 @@ static unsigned long long now()
 	return duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
 }
 
-Timer::Timer(): lasttime(0)
+template <typename T> static T& findEntry(vector<T>& entries, const char* name)
+{
+	for (auto& e: entries)
+		if (e.name == name)
+			return e;
+
+	for (auto& e: entries)
+		if (strcmp(e.name, name) == 0)
+			return e;
+
+	entries.push_back(T(name));
+
+	return entries.back();
+}
+
+struct TraceEvent
+{
+	const char* name;
+	string detail;
+
+	unsigned long long start;
+	unsigned long long end;
+
+	unsigned int thread;
+};
+
+struct Trace
+{
+	mutex lock;
+
+	unsigned long long start;
+	vector<TraceEvent> events;
+};
+
+static atomic<bool> gTraceEnabled;
+static Trace gTrace;
+
+static atomic<unsigned int> gTraceThreads;
+static thread_local unsigned int gTraceThread;
+
+static void traceEvent(const char* name, string detail, unsigned long long start, unsigned long long end)
+{
+	if (!gTraceThread)
+		gTraceThread = ++gTraceThreads;
+
+	lock_guard<mutex> l(gTrace.lock);
+
+	gTrace.events.push_back({ name, move(detail), start, end, gTraceThread });
+}
+
+Timer::Timer(): lasttime(0), lastallocations(0), lastbytes(0)
 {
 	checkpoint();
 }
 
 void Timer::checkpoint()
 {
+	MemoryCounters memory = memoryGetCounters();
+
 	lasttime = now();
+	lastallocations = memory.allocations;
+	lastbytes = memory.bytes;
 }
 
 void Timer::checkpoint(const char* name)
 {
 	unsigned long long time = now();
+	MemoryCounters memory = memoryGetCounters();
 
-	Pass& p = passes[name];
-
-	if (!p.index)
-		p.index = passes.size();
+	Pass& p = findEntry(passes, name);
 
 	p.count++;
 	p.time += time - lasttime;
+	p.allocations += memory.allocations - lastallocations;
+	p.bytes += memory.bytes - lastbytes;
+
+	if (gTraceEnabled)
+		traceEvent(name, string(), lasttime, time);
 
 	lasttime = time;
+	lastallocations = memory.allocations;
+	lastbytes = memory.bytes;
+}
+
+void Timer::count(const char* name, unsigned long long value)
+{
+	Counter& c = findEntry(counters, name);
+
+	c.value += value;
+}
+
+void Timer::merge(const Timer& other)
+{
+	for (auto& op: other.passes)
+	{
+		Pass& p = findEntry(passes, op.name);
+
+		p.count += op.count;
+		p.time += op.time;
+		p.allocations += op.allocations;
+		p.bytes += op.bytes;
+	}
+
+	for (auto& oc: other.counters)
+		count(oc.name, oc.value);
 }
 
 void Timer::dump()
 {
-	vector<const char*> indices(passes.size());
+	for (auto& p: passes)
+		printf("%-20s %d calls, %.2f msec\n", p.name, p.count, double(p.time) / 1e6);
 
+	for (auto& c: counters)
+		printf("%-20s %llu\n", c.name, c.value);
+}
+
+void Timer::dumpMemory()
+{
 	for (auto& p: passes)
-		indices[p.second.index - 1] = p.first.c_str();
+		printf("%-20s %llu allocations, %.2f MB\n", p.name, p.allocations, double(p.bytes) / 1e6);
+
+	printf("%-20s %.2f MB\n", "peak RSS", double(memoryGetPeakRSS()) / 1e6);
+}
+
+void traceStart()
+{
+	gTrace.start = now();
+	gTraceEnabled = true;
+}
+
+static void traceWriteString(FILE* file, const string& value)
+{
+	fputc('"', file);
+
+	for (char ch: value)
+	{
+		if (ch == '"' || ch == '\\')
+			fprintf(file, "\\%c", ch);
+		else if (unsigned(ch) < 32)
+			fprintf(file, "\\u%04x", ch);
+		else
+			fputc(ch, file);
+	}
+
+	fputc('"', file);
+}
 
-	for (auto& n: indices)
+bool traceWrite(const string& path)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	lock_guard<mutex> l(gTrace.lock);
+
+	fputs("{\"traceEvents\":[\n", file);
+
+	for (size_t i = 0; i < gTrace.events.size(); ++i)
 	{
-		Pass& p = passes[n];
+		const TraceEvent& e = gTrace.events[i];
+
+		fprintf(file, "{\"name\":");
+		traceWriteString(file, e.name);
+		fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", e.thread, double(e.start - gTrace.start) / 1e3, double(e.end - e.start) / 1e3);
 
-		printf("%-20s %d calls, %d msec\n", n, p.count, int(p.time / 1000000));
+		if (!e.detail.empty())
+		{
+			fprintf(file, ",\"args\":{\"detail\":");
+			traceWriteString(file, e.detail);
+			fprintf(file, "}");
+		}
+
+		fprintf(file, "}%s\n", i + 1 < gTrace.events.size() ? "," : "");
 	}
+
+	fputs("]}\n", file);
+
+	return fclose(file) == 0;
+}
+
+TraceScope::TraceScope(const char* name): name(name), start(gTraceEnabled ? now() : 0)
+{
+}
+
+TraceScope::TraceScope(const char* name, const Str& detail): name(name), start(gTraceEnabled ? now() : 0)
+{
+	if (start)
+		this->detail = detail.str();
+}
+
+TraceScope::~TraceScope()
+{
+	if (start && gTraceEnabled)
+		traceEvent(name, move(detail), start, now());
 }
\ No newline at end of file
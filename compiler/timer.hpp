@@ -1,25 +1,64 @@
 #pragma once
 
+// Pass and counter names are expected to be string literals; they are compared by pointer first, which avoids hashing the name on every checkpoint
 struct Timer
 {
 	struct Pass
 	{
-		unsigned int index;
+		const char* name;
+
 		unsigned int count;
 		unsigned long long time;
 
-		Pass(): index(0), count(0), time(0)
+		unsigned long long allocations;
+		unsigned long long bytes;
+
+		Pass(const char* name): name(name), count(0), time(0), allocations(0), bytes(0)
 		{
 		}
 	};
 
-	unordered_map<string, Pass> passes;
+	struct Counter
+	{
+		const char* name;
+
+		unsigned long long value;
+
+		Counter(const char* name): name(name), value(0)
+		{
+		}
+	};
+
+	vector<Pass> passes;
+	vector<Counter> counters;
 	unsigned long long lasttime;
+	unsigned long long lastallocations;
+	unsigned long long lastbytes;
 
 	Timer();
 
 	void checkpoint();
 	void checkpoint(const char* name);
 
+	void count(const char* name, unsigned long long value);
+
+	void merge(const Timer& other);
+
 	void dump();
+	void dumpMemory();
+};
+
+// Records Chrome trace events (chrome://tracing) for all timer passes and trace scopes on all threads
+void traceStart();
+bool traceWrite(const string& path);
+
+struct TraceScope
+{
+	const char* name;
+	string detail;
+	unsigned long long start;
+
+	TraceScope(const char* name);
+	TraceScope(const char* name, const Str& detail);
+	~TraceScope();
 };
\ No newline at end of file
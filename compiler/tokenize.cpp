@@ -2,6 +2,13 @@
 #include "tokenize.hpp"
 
 #include "output.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#define TOKENIZE_SIMD
+#include <emmintrin.h>
+#endif
 
 static bool inRange(char ch, char min, char max)
 {
@@ -48,7 +55,95 @@ static bool isAtom(char ch)
 		ch == '\\' || ch == '^' || ch == '`' || ch == '|' || ch == '~';
 }
 
-static Arr<Line> parseLines(Output& output, const char* source, const Str& data)
+// Character classes for the long runs (whitespace, identifiers, comments, strings) that are scanned 16 bytes at a time
+// Each class has a scalar and a vector predicate that return true for characters that continue the run
+#ifdef TOKENIZE_SIMD
+static __m128i simdEqual(__m128i v, char ch)
+{
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch));
+}
+
+static __m128i simdInRange(__m128i v, char min, char max)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(min - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(max + 1)));
+}
+#endif
+
+struct ClassIndent
+{
+	bool operator()(char ch) const { return ch == ' '; }
+
+#ifdef TOKENIZE_SIMD
+	__m128i operator()(__m128i v) const { return simdEqual(v, ' '); }
+#endif
+};
+
+struct ClassSpace
+{
+	bool operator()(char ch) const { return isSpace(ch); }
+
+#ifdef TOKENIZE_SIMD
+	__m128i operator()(__m128i v) const { return _mm_or_si128(simdEqual(v, ' '), _mm_or_si128(simdEqual(v, '\r'), simdEqual(v, '\n'))); }
+#endif
+};
+
+struct ClassIdent
+{
+	bool operator()(char ch) const { return isIdent(ch); }
+
+#ifdef TOKENIZE_SIMD
+	__m128i operator()(__m128i v) const
+	{
+		__m128i letter = _mm_or_si128(simdInRange(v, 'a', 'z'), simdInRange(v, 'A', 'Z'));
+
+		return _mm_or_si128(letter, _mm_or_si128(simdInRange(v, '0', '9'), simdEqual(v, '_')));
+	}
+#endif
+};
+
+// line contents up to a newline or a tab, which is an error
+struct ClassLine
+{
+	bool operator()(char ch) const { return ch != '\n' && ch != '\t'; }
+
+#ifdef TOKENIZE_SIMD
+	__m128i operator()(__m128i v) const { return _mm_andnot_si128(_mm_or_si128(simdEqual(v, '\n'), simdEqual(v, '\t')), _mm_set1_epi8(-1)); }
+#endif
+};
+
+struct ClassNot
+{
+	char terminator;
+
+	bool operator()(char ch) const { return ch != terminator; }
+
+#ifdef TOKENIZE_SIMD
+	__m128i operator()(__m128i v) const { return _mm_andnot_si128(simdEqual(v, terminator), _mm_set1_epi8(-1)); }
+#endif
+};
+
+template <typename Class> static size_t skip(const Str& data, size_t offset, Class cls)
+{
+#ifdef TOKENIZE_SIMD
+	while (offset + 16 <= data.size)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.data + offset));
+		unsigned int stop = ~_mm_movemask_epi8(cls(v)) & 0xffff;
+
+		if (stop)
+			return offset + __builtin_ctz(stop);
+
+		offset += 16;
+	}
+#endif
+
+	while (offset < data.size && cls(data[offset]))
+		offset++;
+
+	return offset;
+}
+
+static Arr<Line> parseLines(Output& output, unsigned int base, const Str& data)
 {
 	Arr<Line> result;
 
@@ -59,21 +154,14 @@ static Arr<Line> parseLines(Output& output, const char* source, const Str& data)
 		size_t start = offset;
 
 		// scan indent
-		unsigned int indent = 0;
+		offset = skip(data, offset, ClassIndent());
 
-		while (offset < data.size && data[offset] == ' ')
-		{
-			offset++;
-			indent++;
-		}
+		unsigned int indent = offset - start;
 
-		while (offset < data.size && data[offset] != '\n')
-		{
-			if (data[offset] == '\t')
-				output.panic(Location(source, result.size, indent, offset, 1), "Source files can't have tabs");
+		offset = skip(data, offset, ClassLine());
 
-			offset++;
-		}
+		if (offset < data.size && data[offset] == '\t')
+			output.panic(Location(base + offset, 1), "Source files can't have tabs");
 
 		result.push({indent, start});
 
@@ -84,16 +172,6 @@ static Arr<Line> parseLines(Output& output, const char* source, const Str& data)
 	return result;
 }
 
-static Location getLocation(const char* source, const Arr<Line>& lines, size_t offset, size_t length)
-{
-	auto it = lower_bound(lines.begin(), lines.end(), offset, [](const Line& line, size_t offset) { return line.offset <= offset; });
-	assert(it != lines.begin());
-
-	auto line = it - 1;
-
-	return Location(source, line - lines.begin(), offset - line->offset, offset, length);
-}
-
 template <typename Fn> static Str scan(const Str& data, size_t& offset, Fn fn)
 {
 	size_t start = offset;
@@ -107,48 +185,104 @@ template <typename Fn> static Str scan(const Str& data, size_t& offset, Fn fn)
 	return Str(data.data + start, end - start);
 }
 
-static Arr<Token> parseTokens(Output& output, const char* source, const Str& data, const Arr<Line>& lines)
+static bool continueLine(const Token& token)
+{
+	return
+		(token.type == Token::TypeAtom && token.data != ">") ||
+		(token.type == Token::TypeBracket && (token.data == "(" || token.data == "[" || token.data == "{"));
+}
+
+static Token getLineToken(const Token& pt)
+{
+	Location loc(pt.location.offset + pt.data.size, 0);
+
+	return { Token::TypeLine, Str(), loc };
+}
+
+static void parseTokens(Output& output, Tokens& tokens, const Str& data)
 {
-	Arr<Token> result;
+	vector<unsigned char> types;
+	vector<Str> contents;
+	vector<Location> locations;
+
+	const Arr<Line>& lines = tokens.lines;
+	unsigned int base = tokens.base;
 
 	size_t offset = 0;
+	size_t start = 0;
+	size_t line = 0;
+	size_t lastLine = 0;
+
+	auto last = [&]() -> Token
+	{
+		return { Token::Type(types.back()), contents.back(), locations.back() };
+	};
+
+	auto append = [&](const Token& token)
+	{
+		types.push_back(token.type);
+		contents.push_back(token.data);
+		locations.push_back(token.location);
+	};
+
+	// newline tokens are inserted as tokens are produced; since tokens are sorted, the line can be found
+	// by walking forward instead of a binary search
+	auto push = [&](Token::Type type, const Str& value)
+	{
+		size_t end = (value.data - data.data) + value.size;
+
+		assert(start < end);
+
+		while (line + 1 < lines.size && lines[line + 1].offset <= start)
+			line++;
+
+		if (!types.empty() && lastLine < line && !continueLine(last()))
+			append(getLineToken(last()));
+
+		append({ type, value, Location(base + start, end - start) });
+
+		lastLine = line;
+	};
 
 	while (offset < data.size)
 	{
-		size_t start = offset;
+		start = offset;
 
 		if (isSpace(data[offset]))
-			offset++;
+			offset = skip(data, offset, ClassSpace());
 		else if (data[offset] == '#')
+			offset = skip(data, offset, ClassNot { '\n' });
+		else if (isIdentStart(data[offset]))
 		{
-			while (offset < data.size && data[offset] != '\n')
-				offset++;
+			offset = skip(data, offset, ClassIdent());
+
+			push(Token::TypeIdent, symbolIntern(Str(data.data + start, offset - start)));
 		}
-		else if (isIdentStart(data[offset]))
-			result.push({Token::TypeIdent, scan(data, offset, isIdent), start});
 		else if (isdigit(data[offset]))
-			result.push({Token::TypeNumber, scan(data, offset, isNumber), start});
+			push(Token::TypeNumber, scan(data, offset, isNumber));
 		else if (data[offset] == '"' || data[offset] == '\'')
 		{
 			char terminator = data[offset];
 			offset++;
-			Str contents = scan(data, offset, [=](char ch) { return ch != terminator; });
+			size_t contentsStart = offset;
+			offset = skip(data, offset, ClassNot { terminator });
+			Str contents(data.data + contentsStart, offset - contentsStart);
 			offset++;
 
-			result.push({terminator == '"' ? Token::TypeString : Token::TypeCharacter, contents, start });
+			push(terminator == '"' ? Token::TypeString : Token::TypeCharacter, contents);
 		}
 		else if (isBracket(data[offset]))
 		{
-			result.push({Token::TypeBracket, Str(data.data + offset, 1), start});
+			push(Token::TypeBracket, Str(data.data + offset, 1));
 			offset++;
 		}
 		else if (isAtom(data[offset]))
 		{
-			result.push({Token::TypeAtom, scan(data, offset, isAtom), start});
+			push(Token::TypeAtom, scan(data, offset, isAtom));
 		}
 		else
 		{
-			Location loc = getLocation(source, lines, offset, 1);
+			Location loc(base + offset, 1);
 
 			if (inRange(data[offset], 0, 32))
 				output.panic(loc, "Unknown character %d", data[offset]);
@@ -157,7 +291,12 @@ static Arr<Token> parseTokens(Output& output, const char* source, const Str& dat
 		}
 	}
 
-	return result;
+	if (!types.empty())
+		append(getLineToken(last()));
+
+	tokens.types = { types.begin(), types.end() };
+	tokens.data = { contents.begin(), contents.end() };
+	tokens.locations = { locations.begin(), locations.end() };
 }
 
 static const char* getClosingBracket(const Str& open)
@@ -167,13 +306,13 @@ static const char* getClosingBracket(const Str& open)
 	return (open == "{") ? "}" : (open == "(") ? ")" : "]";
 }
 
-static void matchBrackets(Output& output, Arr<Token>& tokens)
+static void matchBrackets(Output& output, const Tokens& tokens)
 {
 	vector<size_t> brackets;
 
-	for (size_t i = 0; i < tokens.size; ++i)
+	for (size_t i = 0; i < tokens.size(); ++i)
 	{
-		const Token& t = tokens[i];
+		Token t = tokens.get(i);
 
 		if (t.type == Token::TypeBracket)
 		{
@@ -184,12 +323,16 @@ static void matchBrackets(Output& output, Arr<Token>& tokens)
 				if (brackets.empty())
 					output.panic(t.location, "Unmatched closing bracket %s", t.data.str().c_str());
 
-				const Token& open = tokens[brackets.back()];
+				Token open = tokens.get(brackets.back());
 				const char* close = getClosingBracket(open.data);
 
 				if (t.data != close)
+				{
+					SourcePosition pos = sourceResolve(open.location);
+
 					output.panic(t.location, "Mismatched closing bracket: expected %s to close bracket at (%d,%d)",
-						close, open.location.line + 1, open.location.column + 1);
+						close, pos.line + 1, pos.column + 1);
+				}
 
 				brackets.pop_back();
 			}
@@ -198,72 +341,25 @@ static void matchBrackets(Output& output, Arr<Token>& tokens)
 
 	if (!brackets.empty())
 	{
-		const Token& open = tokens[brackets.back()];
+		Token open = tokens.get(brackets.back());
 		const char* close = getClosingBracket(open.data);
 
 		output.panic(open.location, "Unmatched opening bracket: expected %s to close but found end of file", close);
 	}
 }
 
-static bool continueLine(const Token& token)
-{
-	return
-		(token.type == Token::TypeAtom && token.data != ">") ||
-		(token.type == Token::TypeBracket && (token.data == "(" || token.data == "[" || token.data == "{"));
-}
-
-static Token getLineToken(const Token& pt)
-{
-	const Location& pl = pt.location;
-
-	Location loc(pl.source, pl.line, pl.column + pt.data.size, pl.offset + pt.data.size, 0);
-
-	return { Token::TypeLine, Str(), pt.offset + pt.data.size, 0, loc };
-}
-
-static void insertNewline(Arr<Token>& tokens)
-{
-	vector<Token> result;
-
-	for (size_t i = 0; i < tokens.size; ++i)
-	{
-		if (i > 0 && tokens[i-1].location.line < tokens[i].location.line && !continueLine(tokens[i-1]))
-			result.push_back(getLineToken(tokens[i-1]));
-
-		result.push_back(tokens[i]);
-	}
-
-	if (tokens.size > 0)
-		result.push_back(getLineToken(tokens[tokens.size-1]));
-
-	tokens = { result.begin(), result.end() };
-}
-
 Tokens tokenize(Output& output, const char* source, const Str& data)
 {
-	auto lines = parseLines(output, source, data);
-	auto tokens = parseTokens(output, source, data, lines);
+	Tokens result;
 
-	size_t last = 0;
+	result.base = sourceRegister(source, data);
+	result.lines = parseLines(output, result.base, data);
 
-	for (auto& t: tokens)
-	{
-		size_t start = t.offset;
-		size_t end = (t.data.data - data.data) + t.data.size;
+	parseTokens(output, result, data);
 
-		assert(start < end);
-		assert(start >= last);
+	matchBrackets(output, result);
 
-		t.location = getLocation(source, lines, start, end - start);
-
-		last = end;
-	}
-
-	matchBrackets(output, tokens);
-
-	insertNewline(tokens);
-
-	return { lines, tokens };
+	return result;
 }
 
 string tokenName(Token::Type type)
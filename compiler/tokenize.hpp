@@ -29,17 +29,35 @@ struct Token
 
 	Type type;
 	Str data;
-	size_t offset;
-	size_t matching;
 	Location location;
 };
 
+// Tokens are stored as a structure of arrays; get() assembles a single token
 struct Tokens
 {
 	Arr<Line> lines;
-	Arr<Token> tokens;
+
+	// base offset of the source locations
+	unsigned int base;
+
+	Arr<unsigned char> types;
+	Arr<Str> data;
+	Arr<Location> locations;
+
+	size_t size() const
+	{
+		return types.size;
+	}
+
+	Token get(size_t index) const
+	{
+		return { Token::Type(types[index]), data[index], locations[index] };
+	}
 };
 
+// Lazy function bodies keep tokens in the arena, which never runs destructors, so the arrays must not own heap memory
+static_assert(is_trivially_destructible<Tokens>::value, "Tokens must be trivially destructible");
+
 Tokens tokenize(Output& output, const char* source, const Str& data);
 
 string tokenName(Token::Type type);
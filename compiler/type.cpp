@@ -3,100 +3,534 @@
 
 #include "visit.hpp"
 
-bool TypeConstraints::tryAdd(Ty* lhs, Ty* rhs)
+// Canonical types live in the arena that was active when they were interned; entries are removed when the arena is destroyed
+struct TyEntry
 {
-	assert(lhs != rhs);
-	assert(lhs->kind == Ty::KindUnknown || rhs->kind == Ty::KindUnknown);
+	Ty* type;
+	Arena* arena;
+};
+
+struct TyShard
+{
+	mutex lock;
+	unordered_multimap<size_t, TyEntry> types;
+};
 
-	if (lhs->kind == Ty::KindUnknown && rhs->kind == Ty::KindUnknown)
+static const size_t kTyShards = 16;
+
+static TyShard gTyShards[kTyShards];
+
+static mutex gTyArenasLock;
+static unordered_set<Arena*> gTyArenas;
+
+static void typeReleaseArena(Arena* arena)
+{
+	for (auto& shard: gTyShards)
 	{
-		auto li = data.find(lhs);
-		auto ri = data.find(rhs);
+		lock_guard<mutex> l(shard.lock);
 
-		if (li == data.end() && ri == data.end())
-			data[lhs] = rhs;
-		else if (li == data.end() && ri->second != lhs)
-			data[lhs] = ri->second;
-		else if (ri == data.end() && li->second != rhs)
-			data[rhs] = li->second;
-		else
-			return false;
+		for (auto it = shard.types.begin(); it != shard.types.end(); )
+			if (it->second.arena == arena)
+				it = shard.types.erase(it);
+			else
+				++it;
 	}
-	else
+
+	lock_guard<mutex> l(gTyArenasLock);
+
+	gTyArenas.erase(arena);
+}
+
+static void typeTrackArena(Arena* arena)
+{
+	lock_guard<mutex> l(gTyArenasLock);
+
+	if (gTyArenas.insert(arena).second)
+		arena->addFinalizer([arena]() { typeReleaseArena(arena); });
+}
+
+static size_t typeHashCombine(size_t hash, size_t value)
+{
+	return hash ^ (value + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+}
+
+static size_t typeHashList(size_t hash, const Arr<Ty*>& list)
+{
+	for (Ty* t: list)
+		hash = typeHashCombine(hash, std::hash<Ty*>()(t));
+
+	return hash;
+}
+
+// Children of canonical types are canonical, so hashing and comparison only need to look at the top level
+// Instances are identified by the definition; locations are not part of the key and shared instances don't have one
+static size_t typeHashShallow(Ty* type)
+{
+	size_t hash = type->kind;
+
+	if (UNION_CASE(Tuple, t, type))
+		return typeHashList(hash, t->fields);
+
+	if (UNION_CASE(Array, t, type))
+		return typeHashCombine(hash, std::hash<Ty*>()(t->element));
+
+	if (UNION_CASE(Pointer, t, type))
+		return typeHashCombine(hash, std::hash<Ty*>()(t->element));
+
+	if (UNION_CASE(Function, t, type))
+		return typeHashCombine(typeHashList(hash, t->args), std::hash<Ty*>()(t->ret) + t->varargs);
+
+	if (UNION_CASE(Instance, t, type))
 	{
-		if (lhs->kind != Ty::KindUnknown)
-			swap(lhs, rhs);
+		hash = typeHashCombine(hash, std::hash<TyDef*>()(t->def));
+		hash = typeHashCombine(hash, std::hash<Ty*>()(t->generic));
 
-		auto li = data.find(lhs);
+		return typeHashList(hash, t->tyargs);
+	}
 
-		if (li != data.end())
-			return typeEquals(li->second, rhs);
-		else if (!typeOccurs(rhs, lhs))
-			data[lhs] = rhs;
-		else
+	return hash;
+}
+
+static bool typeEqualsList(const Arr<Ty*>& lhs, const Arr<Ty*>& rhs)
+{
+	if (lhs.size != rhs.size)
+		return false;
+
+	for (size_t i = 0; i < lhs.size; ++i)
+		if (lhs[i] != rhs[i])
 			return false;
+
+	return true;
+}
+
+static bool typeEqualsShallow(Ty* lhs, Ty* rhs)
+{
+	if (lhs->kind != rhs->kind)
+		return false;
+
+	if (UNION_CASE(Tuple, lt, lhs))
+		return typeEqualsList(lt->fields, rhs->dataTuple.fields);
+
+	if (UNION_CASE(Array, la, lhs))
+		return la->element == rhs->dataArray.element;
+
+	if (UNION_CASE(Pointer, lp, lhs))
+		return lp->element == rhs->dataPointer.element;
+
+	if (UNION_CASE(Function, lf, lhs))
+	{
+		UNION_CASE(Function, rf, rhs);
+
+		return lf->ret == rf->ret && lf->varargs == rf->varargs && typeEqualsList(lf->args, rf->args);
+	}
+
+	if (UNION_CASE(Instance, li, lhs))
+	{
+		UNION_CASE(Instance, ri, rhs);
+
+		return li->def == ri->def && li->generic == ri->generic && typeEqualsList(li->tyargs, ri->tyargs);
 	}
 
 	return true;
 }
 
-Ty* TypeConstraints::rewrite(Ty* type)
+// Instances that are waiting for type arguments get them filled in place, so they can't be shared
+static bool typeInstancePending(Ty::Instance* type)
+{
+	if (!type->def)
+		return !type->generic;
+
+	if (UNION_CASE(Struct, def, type->def))
+		return def->tyargs.size != type->tyargs.size;
+
+	return false;
+}
+
+// Returns the flags of the canonical version of the type, or 0 if it can't be canonical
+static unsigned int typeCanonicalFlags(Ty* type)
 {
-	auto it = data.find(type);
+	unsigned int flags = TyFlagCanonical;
+
+	bool canonical = true;
+
+	auto child = [&](Ty* t) { flags |= t->flags; canonical &= (t->flags & TyFlagCanonical) != 0; };
+
+	if (UNION_CASE(Unknown, t, type))
+		return 0;
+
+	// generic arguments are compared by identity
+	if (UNION_CASE(Generic, t, type))
+		return 0;
+
+	if (UNION_CASE(Tuple, t, type))
+		for (Ty* f: t->fields)
+			child(f);
+
+	if (UNION_CASE(Array, t, type))
+		child(t->element);
+
+	if (UNION_CASE(Pointer, t, type))
+		child(t->element);
+
+	if (UNION_CASE(Function, t, type))
+	{
+		for (Ty* a: t->args)
+			child(a);
 
-	if (it != data.end())
+		child(t->ret);
+	}
+
+	if (UNION_CASE(Instance, t, type))
 	{
-		rewrites++;
-		type = it->second;
+		if (typeInstancePending(t))
+			return 0;
+
+		for (Ty* a: t->tyargs)
+			child(a);
+
+		if (t->generic)
+			flags |= TyFlagGeneric;
 	}
 
+	return canonical ? flags : 0;
+}
+
+// Fresh types become canonical in place; existing types may be reachable from other threads, so they are copied
+static Ty* typeIntern(Ty* type, bool fresh)
+{
+	if (type->flags & TyFlagCanonical)
+		return type;
+
+	unsigned int flags = typeCanonicalFlags(type);
+
+	if (!flags)
+		return type;
+
+	size_t hash = typeHashShallow(type);
+
+	TyShard& shard = gTyShards[hash % kTyShards];
+	Arena* arena = arenaGetCurrent();
+
+	Ty* result;
+
+	{
+		lock_guard<mutex> l(shard.lock);
+
+		auto range = shard.types.equal_range(hash);
+
+		for (auto it = range.first; it != range.second; ++it)
+			if (typeEqualsShallow(it->second.type, type))
+				return it->second.type;
+
+		result = fresh ? type : ARENA_NEW(Ty) { *type };
+
+		result->flags = flags;
+
+		// the node is shared between all uses, which keep their own locations for diagnostics
+		if (UNION_CASE(Instance, t, result))
+			t->location = Location();
+
+		shard.types.insert(make_pair(hash, TyEntry { result, arena }));
+	}
+
+	if (arena)
+		typeTrackArena(arena);
+
+	return result;
+}
+
+Ty* typeCanonical(Ty* type)
+{
+	return typeIntern(type, false);
+}
+
+// Maps the list lazily so that a new list is only allocated if one of the elements changes
+template <typename F> static bool typeRebuildList(Arr<Ty*>& result, const Arr<Ty*>& list, F& map)
+{
+	bool changed = false;
+
+	for (size_t i = 0; i < list.size; ++i)
+	{
+		Ty* value = map(list[i]);
+
+		if (value != list[i] && !changed)
+		{
+			changed = true;
+
+			for (size_t j = 0; j < i; ++j)
+				result.push(list[j]);
+		}
+
+		if (changed)
+			result.push(value);
+	}
+
+	return changed;
+}
+
+// Rebuilds the type with all children mapped; unchanged types are shared instead of copied
+template <typename F> static Ty* typeRebuild(Ty* type, F map)
+{
 	if (UNION_CASE(Tuple, t, type))
 	{
 		Arr<Ty*> fields;
 
-		for (Ty* field: t->fields)
-			fields.push(rewrite(field));
+		if (!typeRebuildList(fields, t->fields, map))
+			return typeCanonical(type);
 
-		return UNION_NEW(Ty, Tuple, { fields });
+		return typeIntern(UNION_NEW(Ty, Tuple, { fields }), true);
 	}
 
 	if (UNION_CASE(Array, t, type))
 	{
-		Ty* element = rewrite(t->element);
+		Ty* element = map(t->element);
+
+		if (element == t->element)
+			return typeCanonical(type);
 
-		return UNION_NEW(Ty, Array, { element });
+		return typeIntern(UNION_NEW(Ty, Array, { element }), true);
 	}
 
 	if (UNION_CASE(Pointer, t, type))
 	{
-		Ty* element = rewrite(t->element);
+		Ty* element = map(t->element);
 
-		return UNION_NEW(Ty, Pointer, { element });
+		if (element == t->element)
+			return typeCanonical(type);
+
+		return typeIntern(UNION_NEW(Ty, Pointer, { element }), true);
 	}
 
 	if (UNION_CASE(Function, t, type))
 	{
 		Arr<Ty*> args;
 
-		for (Ty* arg: t->args)
-			args.push(rewrite(arg));
+		bool changed = typeRebuildList(args, t->args, map);
+
+		Ty* ret = map(t->ret);
 
-		Ty* ret = rewrite(t->ret);
+		if (!changed && ret == t->ret)
+			return typeCanonical(type);
 
-		return UNION_NEW(Ty, Function, { args, ret, t->varargs });
+		return typeIntern(UNION_NEW(Ty, Function, { changed ? args : t->args, ret, t->varargs }), true);
 	}
 
 	if (UNION_CASE(Instance, t, type))
 	{
 		Arr<Ty*> tyargs;
 
-		for (Ty* arg: t->tyargs)
-			tyargs.push(rewrite(arg));
+		if (!typeRebuildList(tyargs, t->tyargs, map))
+		{
+			if (!typeInstancePending(t))
+				return typeCanonical(type);
+
+			for (Ty* arg: t->tyargs)
+				tyargs.push(arg);
+		}
 
-		return UNION_NEW(Ty, Instance, { t->name, t->location, tyargs, t->def, t->generic });
+		return typeIntern(UNION_NEW(Ty, Instance, { t->name, t->location, tyargs, t->def, t->generic }), true);
 	}
 
-	return type;
+	return typeCanonical(type);
+}
+
+int TypeConstraints::lookup(Ty* type)
+{
+	UNION_CASE(Unknown, u, type);
+	assert(u);
+
+	if (u->index < entries.size() && entries[u->index].var == type)
+		return u->index;
+
+	if (transient)
+		for (size_t i = 0; i < entries.size(); ++i)
+			if (entries[i].var == type)
+				return i;
+
+	return -1;
+}
+
+unsigned int TypeConstraints::add(Ty* type)
+{
+	int index = lookup(type);
+
+	if (index >= 0)
+		return index;
+
+	unsigned int result = entries.size();
+
+	entries.push_back({ type, result, 0, nullptr });
+
+	if (!transient)
+		type->dataUnknown.index = result;
+
+	return result;
+}
+
+unsigned int TypeConstraints::find(unsigned int index)
+{
+	unsigned int root = index;
+
+	while (entries[root].parent != root)
+		root = entries[root].parent;
+
+	while (entries[index].parent != root)
+	{
+		unsigned int next = entries[index].parent;
+
+		entries[index].parent = root;
+		index = next;
+	}
+
+	return root;
+}
+
+// Checks if the set occurs in the type, following the types of other sets
+bool TypeConstraints::occurs(Ty* type, unsigned int root)
+{
+	if (type->flags & TyFlagCanonical)
+		return false;
+
+	bool result = false;
+
+	visitType(type, [&](Ty* ty) {
+		if (result || ty->kind != Ty::KindUnknown)
+			return;
+
+		int index = lookup(ty);
+
+		if (index < 0)
+			return;
+
+		unsigned int set = find(index);
+
+		result = (set == root) || (entries[set].type && occurs(entries[set].type, root));
+	});
+
+	return result;
+}
+
+void TypeConstraints::bind(unsigned int root, Ty* type)
+{
+	assert(!entries[root].type);
+
+	entries[root].type = type;
+
+	// the variable was a root without a type, so it wasn't rewritten before
+	bound.push_back(entries[root].var);
+}
+
+bool TypeConstraints::tryAdd(Ty* lhs, Ty* rhs)
+{
+	assert(lhs != rhs);
+	assert(lhs->kind == Ty::KindUnknown || rhs->kind == Ty::KindUnknown);
+
+	if (lhs->kind != Ty::KindUnknown)
+		swap(lhs, rhs);
+
+	unsigned int li = find(add(lhs));
+
+	if (rhs->kind == Ty::KindUnknown)
+	{
+		unsigned int ri = find(add(rhs));
+
+		if (li == ri)
+			return true;
+
+		Ty* lt = entries[li].type;
+		Ty* rt = entries[ri].type;
+
+		if (lt && occurs(lt, ri))
+			return false;
+
+		if (rt && occurs(rt, li))
+			return false;
+
+		// union by rank; the root keeps the type of its set if it has one
+		if (entries[li].rank < entries[ri].rank)
+		{
+			swap(li, ri);
+			swap(lt, rt);
+		}
+
+		if (entries[li].rank == entries[ri].rank)
+			entries[li].rank++;
+
+		entries[ri].parent = li;
+
+		if (!rt)
+			bound.push_back(entries[ri].var);
+
+		if (!lt && rt)
+			bind(li, rt);
+		else if (lt && rt)
+			return typeUnify(lt, rt, this);
+
+		return true;
+	}
+	else
+	{
+		if (Ty* lt = entries[li].type)
+			return typeUnify(lt, rhs, this);
+
+		if (occurs(rhs, li))
+			return false;
+
+		bind(li, rhs);
+
+		return true;
+	}
+}
+
+bool TypeConstraints::isBound(Ty* type)
+{
+	int index = lookup(type);
+
+	if (index < 0)
+		return false;
+
+	unsigned int root = find(index);
+
+	return entries[root].type || entries[root].var != type;
+}
+
+Ty* TypeConstraints::rewrite(Ty* type)
+{
+	if (type->flags & TyFlagCanonical)
+		return type;
+
+	if (type->kind == Ty::KindUnknown)
+	{
+		int index = lookup(type);
+
+		if (index < 0)
+			return type;
+
+		unsigned int root = find(index);
+
+		if (Ty* bound = entries[root].type)
+		{
+			rewrites++;
+
+			// the type can refer to other sets; it's rewritten once so that chains are resolved in a single pass
+			Ty* result = rewrite(bound);
+
+			entries[root].type = result;
+
+			return result;
+		}
+
+		if (entries[root].var != type)
+		{
+			rewrites++;
+
+			return entries[root].var;
+		}
+
+		return type;
+	}
+
+	return typeRebuild(type, [&](Ty* child) { return rewrite(child); });
 }
 
 bool typeUnify(Ty* lhs, Ty* rhs, TypeConstraints* constraints)
@@ -104,6 +538,10 @@ bool typeUnify(Ty* lhs, Ty* rhs, TypeConstraints* constraints)
 	if (lhs == rhs)
 		return true;
 
+	// canonical types don't have unknowns so they can only unify if they are the same
+	if (lhs->flags & rhs->flags & TyFlagCanonical)
+		return false;
+
 	if (constraints && (lhs->kind == Ty::KindUnknown || rhs->kind == Ty::KindUnknown))
 		return constraints->tryAdd(lhs, rhs);
 
@@ -188,6 +626,10 @@ bool typeOccurs(Ty* lhs, Ty* rhs)
 	if (lhs == rhs)
 		return true;
 
+	// children of canonical types are canonical
+	if ((lhs->flags & TyFlagCanonical) && !(rhs->flags & TyFlagCanonical))
+		return false;
+
 	if (UNION_CASE(Tuple, lt, lhs))
 	{
 		for (auto& f: lt->fields)
@@ -230,6 +672,9 @@ bool typeOccurs(Ty* lhs, Ty* rhs)
 
 bool typeKnown(Ty* type)
 {
+	if (type->flags & TyFlagCanonical)
+		return true;
+
 	if (UNION_CASE(Unknown, tu, type))
 	{
 		return false;
@@ -277,41 +722,8 @@ bool typeKnown(Ty* type)
 
 Ty* typeInstantiate(Ty* type, const function<Ty*(Ty*)>& inst)
 {
-	if (UNION_CASE(Tuple, t, type))
-	{
-		Arr<Ty*> fields;
-
-		for (Ty* field: t->fields)
-			fields.push(typeInstantiate(field, inst));
-
-		return UNION_NEW(Ty, Tuple, { fields });
-	}
-
-	if (UNION_CASE(Array, t, type))
-	{
-		Ty* element = typeInstantiate(t->element, inst);
-
-		return UNION_NEW(Ty, Array, { element });
-	}
-
-	if (UNION_CASE(Pointer, t, type))
-	{
-		Ty* element = typeInstantiate(t->element, inst);
-
-		return UNION_NEW(Ty, Pointer, { element });
-	}
-
-	if (UNION_CASE(Function, t, type))
-	{
-		Arr<Ty*> args;
-
-		for (Ty* arg: t->args)
-			args.push(typeInstantiate(arg, inst));
-
-		Ty* ret = typeInstantiate(t->ret, inst);
-
-		return UNION_NEW(Ty, Function, { args, ret, t->varargs });
-	}
+	if ((type->flags & TyFlagCanonical) && !(type->flags & TyFlagGeneric))
+		return type;
 
 	if (UNION_CASE(Instance, t, type))
 	{
@@ -325,18 +737,9 @@ Ty* typeInstantiate(Ty* type, const function<Ty*(Ty*)>& inst)
 
 			return type;
 		}
-		else
-		{
-			Arr<Ty*> tyargs;
-
-			for (Ty* arg: t->tyargs)
-				tyargs.push(typeInstantiate(arg, inst));
-
-			return UNION_NEW(Ty, Instance, { t->name, t->location, tyargs, t->def, t->generic });
-		}
 	}
 
-	return type;
+	return typeRebuild(type, [&](Ty* child) { return typeInstantiate(child, inst); });
 }
 
 Ty* typeMember(Ty* type, int index)
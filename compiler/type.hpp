@@ -19,7 +19,7 @@ struct StructField
 UNION_DECL(TyDef, UD_TYDEF)
 
 #define UD_TY(X) \
-	X(Unknown, {}) \
+	X(Unknown, { unsigned int index; }) \
 	X(Void, {}) \
 	X(Bool, {}) \
 	X(Integer, {}) \
@@ -32,16 +32,57 @@ UNION_DECL(TyDef, UD_TYDEF)
 	X(Instance, { Str name; Location location; Arr<Ty*> tyargs; TyDef* def; Ty* generic; }) \
 	X(Generic, { Str name; Location location; }) \
 
-UNION_DECL(Ty, UD_TY)
+// flags are only valid for canonical types, which are immutable once created
+UNION_DECL_EXTRA(Ty, UD_TY, unsigned int flags;)
 
+enum TyFlags
+{
+	TyFlagCanonical = 1 << 0,
+	TyFlagGeneric = 1 << 1,
+};
+
+struct OverloadCache;
+
+// Type variables are kept in a union-find forest; Unknown::index refers to the entry of the variable
+// if the entry points back to it, otherwise the variable hasn't been seen by these constraints yet
 struct TypeConstraints
 {
-	unordered_map<Ty*, Ty*> data;
+	struct Entry
+	{
+		Ty* var;
+
+		unsigned int parent;
+		unsigned int rank;
+
+		// type of all variables in the set; only valid for the root
+		Ty* type;
+	};
+
+	vector<Entry> entries;
+
+	// variables that are rewritten to a different type
+	vector<Ty*> bound;
+
+	// constraints that are discarded right away (e.g. when testing overload candidates) don't store indices in the variables
+	bool transient = false;
+
 	int rewrites = 0;
 
+	// overload resolution results that outlive the constraints; owned by the typechecker
+	OverloadCache* overloads = nullptr;
+
 	bool tryAdd(Ty* lhs, Ty* rhs);
+	bool isBound(Ty* type);
 
 	Ty* rewrite(Ty* type);
+
+private:
+	int lookup(Ty* type);
+	unsigned int add(Ty* type);
+	unsigned int find(unsigned int index);
+
+	bool occurs(Ty* type, unsigned int root);
+	void bind(unsigned int root, Ty* type);
 };
 
 bool typeUnify(Ty* lhs, Ty* rhs, TypeConstraints* constraints);
@@ -49,6 +90,9 @@ bool typeEquals(Ty* lhs, Ty* rhs);
 bool typeOccurs(Ty* lhs, Ty* rhs);
 bool typeKnown(Ty* type);
 
+// Fully known types are hash-consed so that structurally equal types share one node; other types are returned as is
+Ty* typeCanonical(Ty* type);
+
 Ty* typeInstantiate(Ty* type, const function<Ty*(Ty*)>& inst);
 
 Ty* typeMember(Ty* type, int index);
@@ -4,6 +4,8 @@
 #include "ast.hpp"
 #include "visit.hpp"
 #include "output.hpp"
+#include "resolve.hpp"
+#include "source.hpp"
 
 static void typeMustKnow(Ty* type, Output& output, const Location& location)
 {
@@ -64,13 +66,15 @@ static string getCandidates(const Arr<Variable*>& targets)
 
 	for (Variable* v: targets)
 	{
+		SourcePosition pos = sourceResolve(v->location);
+
 		char linecolumn[32];
-		sprintf(linecolumn, "(%d,%d)", v->location.line + 1, v->location.column + 1);
+		sprintf(linecolumn, "(%d,%d)", pos.line + 1, pos.column + 1);
 
 		result += "\tCandidate: ";
 		result += typeName(v->type);
 		result += "; declared at ";
-		result += v->location.source;
+		result += pos.source;
 		result += linecolumn;
 		result += "\n";
 	}
@@ -98,6 +102,7 @@ static bool isCandidateValid(Variable* target, const vector<Ty*>& args)
 		return false;
 
 	TypeConstraints constraints;
+	constraints.transient = true;
 
 	for (size_t i = 0; i < fnty->args.size; ++i)
 		if (!typeUnify(fnty->args[i], args[i], &constraints))
@@ -122,6 +127,113 @@ static size_t reduceCandidates(Arr<Variable*>& targets, const vector<Ty*>& args)
 	return size - write;
 }
 
+// Overload sets are resolved once per combination of fully known argument types; candidates and arguments are compared by identity
+struct OverloadCache
+{
+	struct Entry
+	{
+		vector<Variable*> targets;
+		vector<Ty*> args;
+
+		// candidates with signatures that can still change are tested at every call site
+		bool valid;
+
+		vector<Variable*> result;
+	};
+
+	unordered_multimap<size_t, Entry> entries;
+};
+
+// Signatures without type variables can't be rewritten, so the results of testing them stay valid
+static bool isSignatureFixed(Ty* type)
+{
+	bool result = true;
+
+	visitType(type, [&](Ty* ty) {
+		if (UNION_CASE(Unknown, t, ty))
+			result = false;
+
+		// type arguments omitted from the signature are filled in place once the body is typechecked
+		if (UNION_CASE(Instance, t, ty))
+			if (t->def && t->tyargs.size == 0)
+				if (UNION_CASE(Struct, def, t->def))
+					result &= def->tyargs.size == 0;
+	});
+
+	return result;
+}
+
+static size_t hashCombine(size_t hash, size_t value)
+{
+	return hash ^ (value + 0x9e3779b9 + (hash << 6) + (hash >> 2));
+}
+
+static bool isOverloadEntryMatching(const OverloadCache::Entry& entry, const Arr<Variable*>& targets, const vector<Ty*>& args)
+{
+	if (entry.targets.size() != targets.size || entry.args != args)
+		return false;
+
+	for (size_t i = 0; i < targets.size; ++i)
+		if (entry.targets[i] != targets[i])
+			return false;
+
+	return true;
+}
+
+static size_t reduceCandidatesCached(OverloadCache& cache, Arr<Variable*>& targets, vector<Ty*>& args)
+{
+	size_t hash = 0;
+
+	for (auto& a: args)
+	{
+		a = typeCanonical(a);
+
+		if ((a->flags & TyFlagCanonical) == 0)
+			return reduceCandidates(targets, args);
+
+		hash = hashCombine(hash, std::hash<Ty*>()(a));
+	}
+
+	for (Variable* t: targets)
+		hash = hashCombine(hash, std::hash<Variable*>()(t));
+
+	auto range = cache.entries.equal_range(hash);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const OverloadCache::Entry& entry = it->second;
+
+		if (isOverloadEntryMatching(entry, targets, args))
+		{
+			if (!entry.valid)
+				return reduceCandidates(targets, args);
+
+			size_t size = targets.size;
+
+			for (size_t i = 0; i < entry.result.size(); ++i)
+				targets[i] = entry.result[i];
+
+			targets.size = entry.result.size();
+
+			return size - targets.size;
+		}
+	}
+
+	OverloadCache::Entry entry = { vector<Variable*>(targets.begin(), targets.end()), args, true };
+
+	for (Variable* t: targets)
+		entry.valid &= isSignatureFixed(t->type);
+
+	size_t result = reduceCandidates(targets, args);
+
+	if (entry.valid)
+		entry.result.assign(targets.begin(), targets.end());
+
+	cache.entries.insert(make_pair(hash, move(entry)));
+
+	return result;
+}
+
 static bool isAssignable(Ast* node)
 {
 	if (UNION_CASE(Ident, n, node))
@@ -299,7 +411,10 @@ static void typeCall(Output& output, Ast::Call* n, TypeConstraints* constraints)
 			for (auto& a: n->args)
 				args.push_back(astType(a));
 
-			constraints->rewrites += reduceCandidates(ne->targets, args);
+			if (constraints->overloads)
+				constraints->rewrites += reduceCandidatesCached(*constraints->overloads, ne->targets, args);
+			else
+				constraints->rewrites += reduceCandidates(ne->targets, args);
 		}
 	}
 
@@ -694,18 +809,207 @@ static bool instantiateNode(Output& output, Ast* node, TypeConstraints* constrai
 	return false;
 }
 
-int typeckPropagate(Output& output, Ast* root)
+// Statements of the module are solved as separate units; a unit that stops changing is only revisited
+// when one of the type variables it refers to is bound by another unit
+struct TypeckUnit
 {
-	TypeConstraints constraints;
-	type(output, root, &constraints);
+	Ast* node;
 
-	// Currently this also resolves overloads; it's probably better to do it in the type() to speed up convergence
-	visitAst(root, [&](Ast* node) { return instantiateNode(output, node, &constraints); });
+	bool active;
+	bool woken;
+	bool changed;
 
-	if (!constraints.data.empty())
-		visitAst(root, propagate, constraints);
+	// type variables that can change the result of typechecking the unit when they are bound
+	vector<Ty*> dependencies;
+};
+
+static void gatherUnknowns(Ty* type, vector<Ty*>& result)
+{
+	if (type->flags & TyFlagCanonical)
+		return;
+
+	visitType(type, [&](Ty* ty) {
+		if (ty->kind == Ty::KindUnknown)
+			result.push_back(ty);
+	});
+}
+
+static Ty* getNodeType(Ast* node)
+{
+	if (UNION_CASE(FnDecl, n, node))
+		return n->var->type;
+
+	// blocks have the type of the last expression, which is reported on its own
+	if (node->kind == Ast::KindBlock || node->kind == Ast::KindModule)
+		return nullptr;
+
+	return astType(node);
+}
+
+int typeckSolve(Output& output, Ast* root, TypeckStats* stats)
+{
+	vector<TypeckUnit> units;
+
+	UNION_CASE(Module, module, root);
+	UNION_CASE(Block, block, module ? module->body : root);
+
+	if (block)
+	{
+		for (auto& n: block->body)
+			units.push_back({ n, true });
+	}
+	else
+		units.push_back({ root, true });
+
+	// units that no longer change, indexed by their dependencies
+	unordered_map<Ty*, vector<size_t>> dormant;
+
+	OverloadCache overloads;
+
+	int rounds = 0;
+	bool pending = true;
+
+	while (pending)
+	{
+		rounds++;
+
+		TypeConstraints constraints;
+		constraints.overloads = &overloads;
+
+		if (stats)
+			stats->rounds.push_back({ 0, int(count_if(units.begin(), units.end(), [](const TypeckUnit& u) { return u.active; })) });
+
+		for (auto& u: units)
+			if (u.active)
+			{
+				size_t bindings = constraints.bound.size();
+				int rewrites = constraints.rewrites;
+
+				type(output, u.node, &constraints);
+
+				u.changed = constraints.bound.size() != bindings || constraints.rewrites != rewrites;
+			}
+
+		// Currently this also resolves overloads; it's probably better to do it in the type() to speed up convergence
+		for (auto& u: units)
+			if (u.active)
+			{
+				int rewrites = constraints.rewrites;
+
+				u.dependencies.clear();
+
+				visitAst(u.node, [&](Ast* node) {
+					bool result = instantiateNode(output, node, &constraints);
+
+					// overload resolution and instantiation depend on the signatures of the targets, which can be rewritten by other units
+					if (UNION_CASE(Ident, n, node))
+						if (!n->resolved)
+							for (auto& t: n->targets)
+								gatherUnknowns(t->type, u.dependencies);
+
+					return result;
+				});
+
+				u.changed |= constraints.rewrites != rewrites;
+			}
+
+		if (output.errors)
+			return rounds;
+
+		// dormant units that refer to the bound type variables need to be rewritten and typechecked again
+		for (auto& b: constraints.bound)
+		{
+			auto it = dormant.find(b);
+
+			if (it != dormant.end())
+			{
+				for (auto& index: it->second)
+					units[index].woken = true;
+
+				dormant.erase(it);
+			}
+		}
+
+		pending = false;
+
+		for (size_t i = 0; i < units.size(); ++i)
+		{
+			TypeckUnit& u = units[i];
+
+			if (!u.active && !u.woken)
+				continue;
+
+			int rewrites = constraints.rewrites;
+			int members = 0;
+
+			bool gather = u.active && !u.changed;
+
+			// Rewrites don't depend on the traversal order, but member resolution needs the rewritten types of the children
+			visitAstPost(u.node, [&](Ast* node) {
+				if (!constraints.bound.empty())
+					propagate(constraints, node);
+
+				members += resolveMemberRefs(output, node);
+
+				if (gather)
+				{
+					visitAstTypes(node, [&](Ty* ty) { gatherUnknowns(ty, u.dependencies); });
+
+					if (UNION_CASE(FnDecl, n, node))
+						for (auto& a: n->args)
+							gatherUnknowns(a->type, u.dependencies);
+				}
+			});
+
+			u.changed |= constraints.rewrites != rewrites || members != 0;
+
+			if (gather && !u.changed)
+			{
+				for (auto& d: u.dependencies)
+					u.changed |= constraints.isBound(d);
+
+				if (!u.changed)
+					for (auto& d: u.dependencies)
+						dormant[d].push_back(i);
+			}
+
+			u.active = u.changed || u.woken;
+			u.woken = false;
+
+			pending |= u.active;
+		}
+
+		if (stats)
+		{
+			TypeckRound& round = stats->rounds.back();
+
+			round.rewrites = constraints.rewrites;
+
+			for (auto& u: units)
+				visitAst(u.node, [&](Ast* node) -> bool {
+					Ty* type = getNodeType(node);
+
+					if (type && !typeKnown(type))
+						round.unknowns.push_back(make_pair(node, type));
+
+					return false;
+				});
+		}
+
+		if (output.errors)
+			return rounds;
+	}
+
+	// the block isn't a part of any unit
+	if (block)
+	{
+		block->type = (block->body.size == 0) ? UNION_NEW(Ty, Void, {}) : astType(block->body[block->body.size - 1]);
+
+		if (module)
+			module->type = block->type;
+	}
 
-	return constraints.rewrites;
+	return rounds;
 }
 
 static bool verifyNode(Output& output, Ast* node)
@@ -2,7 +2,24 @@
 
 struct Output;
 struct Ast;
+struct Ty;
 
-int typeckPropagate(Output& output, Ast* root);
+// Convergence statistics of typeckSolve, reported by --typeck-stats
+struct TypeckRound
+{
+	int rewrites;
+	int units;
+
+	// function declarations with signatures and expressions with types that are still unknown after the round, with these types
+	vector<pair<Ast*, Ty*>> unknowns;
+};
+
+struct TypeckStats
+{
+	vector<TypeckRound> rounds;
+};
+
+// Infers types and resolves member references until the fixpoint is reached; returns the number of rounds
+int typeckSolve(Output& output, Ast* root, TypeckStats* stats = nullptr);
 
 void typeckVerify(Output& output, Ast* root);
@@ -14,7 +14,7 @@
 
 #define UNION_NEW(type, kindname, ...) \
 		([&]() -> type* { \
-			type* __result = new type { type::Kind##kindname, { 0 } }; \
+			type* __result = ARENA_NEW(type) { type::Kind##kindname, { 0 } }; \
 			__result->data##kindname = __VA_ARGS__; \
 			return __result; \
 		})()
@@ -23,9 +23,12 @@
 #define UNION_DECL_STRUCT(name, ...) struct name __VA_ARGS__;
 #define UNION_DECL_FIELD(name, ...) name data##name;
 
-#define UNION_DECL(name, def) \
+#define UNION_DECL_EXTRA(name, def, extra) \
 	struct name { \
 		enum Kind { def(UNION_DECL_KIND) } kind; \
 		def(UNION_DECL_STRUCT) \
 		union { int dummy; def(UNION_DECL_FIELD) }; \
+		extra \
 	};
+
+#define UNION_DECL(name, def) UNION_DECL_EXTRA(name, def, )
@@ -1,13 +1,212 @@
 #pragma once
 
-struct Ast;
-struct Ty;
+#include "ast.hpp"
 
-void visitAst(Ast* node, const function<bool (Ast*)>& f);
-void visitAstInner(Ast* node, const function<bool (Ast*)>& f);
+// Visitors are templates so that the callbacks get inlined into the traversal; several per-node actions
+// can be fused into one traversal by calling them from the same callback
+template <typename F> inline void visitAstChildren(Ast* node, F& f)
+{
+	if (UNION_CASE(LiteralTuple, n, node))
+	{
+		for (auto& c: n->fields)
+			f(c);
+	}
+	else if (UNION_CASE(LiteralArray, n, node))
+	{
+		for (auto& c: n->elements)
+			f(c);
+	}
+	else if (UNION_CASE(LiteralStruct, n, node))
+	{
+		for (auto& c: n->fields)
+			f(c.second);
+	}
+	else if (UNION_CASE(Member, n, node))
+	{
+		f(n->expr);
+	}
+	else if (UNION_CASE(Block, n, node))
+	{
+		for (auto& c: n->body)
+			f(c);
+	}
+	else if (UNION_CASE(Module, n, node))
+	{
+		f(n->body);
+	}
+	else if (UNION_CASE(Call, n, node))
+	{
+		f(n->expr);
+
+		for (auto& a: n->args)
+			f(a);
+	}
+	else if (UNION_CASE(Unary, n, node))
+	{
+		f(n->expr);
+	}
+	else if (UNION_CASE(Binary, n, node))
+	{
+		f(n->left);
+		f(n->right);
+	}
+	else if (UNION_CASE(Index, n, node))
+	{
+		f(n->expr);
+		f(n->index);
+	}
+	else if (UNION_CASE(Assign, n, node))
+	{
+		f(n->left);
+		f(n->right);
+	}
+	else if (UNION_CASE(If, n, node))
+	{
+		f(n->cond);
+		f(n->thenbody);
+
+		if (n->elsebody)
+			f(n->elsebody);
+	}
+	else if (UNION_CASE(For, n, node))
+	{
+		f(n->expr);
+		f(n->body);
+	}
+	else if (UNION_CASE(While, n, node))
+	{
+		f(n->expr);
+		f(n->body);
+	}
+	else if (UNION_CASE(FnDecl, n, node))
+	{
+		if (n->body)
+			f(n->body);
+	}
+	else if (UNION_CASE(Fn, n, node))
+	{
+		f(n->decl);
+	}
+	else if (UNION_CASE(VarDecl, n, node))
+	{
+		f(n->expr);
+	}
+	else if (UNION_CASE(TyDecl, n, node))
+	{
+		if (UNION_CASE(Struct, t, n->def))
+		{
+			for (auto& c: t->fields)
+				if (c.expr)
+					f(c.expr);
+		}
+	}
+}
+
+template <typename F> inline void visitAstRec(F& f, Ast* node, Ast* ignore = nullptr)
+{
+	if (node != ignore && f(node))
+		return;
+
+	auto rec = [&](Ast* child) { visitAstRec(f, child); };
+
+	visitAstChildren(node, rec);
+}
 
-void visitAstTypes(Ast* node, const function<void (Ty*)>& f);
-void visitType(Ty* type, const function<void (Ty*)>& f);
+template <typename F> inline void visitAstPostRec(F& f, Ast* node)
+{
+	auto rec = [&](Ast* child) { visitAstPostRec(f, child); };
+
+	visitAstChildren(node, rec);
+
+	f(node);
+}
+
+template <typename F> inline void visitAst(Ast* node, F f)
+{
+	visitAstRec(f, node);
+}
+
+template <typename F> inline void visitAstInner(Ast* node, F f)
+{
+	visitAstRec(f, node, /* ignore= */ node);
+}
+
+// Visits children before the node itself; the callback can't skip the children
+template <typename F> inline void visitAstPost(Ast* node, F f)
+{
+	visitAstPostRec(f, node);
+}
+
+template <typename F> inline void visitAstTypes(Ast* node, F f)
+{
+	if (Ty* type = astType(node))
+		f(type);
+
+	if (UNION_CASE(Ident, n, node))
+	{
+		for (auto& a: n->tyargs)
+			f(a);
+	}
+	else if (UNION_CASE(For, n, node))
+	{
+		f(n->var->type);
+
+		if (n->index)
+			f(n->index->type);
+	}
+	else if (UNION_CASE(FnDecl, n, node))
+	{
+		f(n->var->type);
+	}
+	else if (UNION_CASE(VarDecl, n, node))
+	{
+		f(n->var->type);
+	}
+	else if (UNION_CASE(TyDecl, n, node))
+	{
+		if (UNION_CASE(Struct, d, n->def))
+		{
+			for (auto& c: d->fields)
+				f(c.type);
+		}
+	}
+}
+
+template <typename F> inline void visitTypeRec(F& f, Ty* type)
+{
+	f(type);
+
+	if (UNION_CASE(Tuple, t, type))
+	{
+		for (auto& e: t->fields)
+			visitTypeRec(f, e);
+	}
+	else if (UNION_CASE(Array, t, type))
+	{
+		visitTypeRec(f, t->element);
+	}
+	else if (UNION_CASE(Pointer, t, type))
+	{
+		visitTypeRec(f, t->element);
+	}
+	else if (UNION_CASE(Function, t, type))
+	{
+		for (auto& a: t->args)
+			visitTypeRec(f, a);
+
+		visitTypeRec(f, t->ret);
+	}
+	else if (UNION_CASE(Instance, t, type))
+	{
+		for (auto& a: t->tyargs)
+			visitTypeRec(f, a);
+	}
+}
+
+template <typename F> inline void visitType(Ty* type, F f)
+{
+	visitTypeRec(f, type);
+}
 
 template <typename F, typename FC> inline void visitAst(Ast* node, F f, FC& fc)
 {
@@ -61,6 +61,11 @@ AIKE_EXTERN void* gcNewArray(void* ti, size_t count, size_t elementSize)
 	return result;
 }
 
+AIKE_EXTERN void gcRoot(void* data, size_t size)
+{
+	if (!GC_root(data, size)) panic("Error registering %lld bytes as a GC root", static_cast<long long>(size));
+}
+
 AIKE_EXTERN void gcCollect()
 {
 	GC_enable();
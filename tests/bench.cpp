@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <algorithm>
+
+#include "process.hpp"
+
+using namespace std;
+
+// Synthetic program; the first file is the main module, the rest are imported by it directly or transitively
+struct Workload
+{
+	string name;
+
+	vector<pair<string, string>> files;
+};
+
+// Thousands of non-generic functions that call each other
+Workload generateFunctions(int scale)
+{
+	int count = 2000 * scale;
+
+	ostringstream os;
+
+	os << "fn f0(a: int, b: int): int\n";
+	os << "    a + b\n\n";
+
+	for (int i = 1; i < count; ++i)
+	{
+		os << "fn f" << i << "(a: int, b: int): int\n";
+		os << "    var c = a * " << (i % 7 + 1) << " + b\n";
+		os << "    if c < b\n";
+		os << "        f" << (i - 1) << "(c + 1, b) * 2\n";
+		os << "    else\n";
+		os << "        f" << (i / 2) << "(b, c) - 1\n\n";
+	}
+
+	os << "print(f" << (count - 1) << "(1, 2))\n";
+
+	return { "functions", { { "main.aike", os.str() } } };
+}
+
+// Chains of generic functions where every call wraps the argument in another layer of a generic struct
+Workload generateGenerics(int scale)
+{
+	int chains = 50 * scale;
+	int depth = 20;
+
+	const char* values[] = { "1", "1.5", "true", "\"s\"" };
+
+	ostringstream os;
+
+	os << "struct Box<T>\n";
+	os << "    value: T\n\n";
+
+	for (int c = 0; c < chains; ++c)
+	{
+		os << "fn c" << c << "_0<T>(v: T)\n";
+		os << "    v\n\n";
+
+		for (int k = 1; k <= depth; ++k)
+		{
+			os << "fn c" << c << "_" << k << "<T>(v: T)\n";
+			os << "    c" << c << "_" << (k - 1) << "(Box { value = v })\n\n";
+		}
+
+		os << "var r" << c << " = c" << c << "_" << depth << "(" << values[c % 4] << ")\n\n";
+	}
+
+	return { "generics", { { "main.aike", os.str() } } };
+}
+
+// Wide overload sets on many struct types, and arithmetic that goes through the prelude operator overloads
+Workload generateOverloads(int scale)
+{
+	int types = 100 * scale;
+	int names = 10;
+	int expressions = 500 * scale;
+
+	ostringstream os;
+
+	for (int i = 0; i < types; ++i)
+	{
+		os << "struct T" << i << "\n";
+		os << "    v: int = " << i << "\n\n";
+	}
+
+	for (int o = 0; o < names; ++o)
+		for (int i = 0; i < types; ++i)
+		{
+			os << "fn op" << o << "(a: T" << i << ", b: int): int\n";
+			os << "    a.v + b * " << o << "\n\n";
+		}
+
+	for (int o = 0; o < names; ++o)
+		for (int i = 0; i < types; ++i)
+			os << "var x" << o << "_" << i << " = op" << o << "(T" << i << " {}, " << i << ")\n";
+
+	os << "\n";
+
+	for (int n = 0; n < expressions; ++n)
+	{
+		os << "var e" << n << " = (" << n << " + 1) * 2 - " << n << " % 3 + " << n << " / 4 * (" << n << " - 5)\n";
+		os << "var g" << n << " = " << n << ".0 * 0.5 + 1.5 / 2.0 - 3.0 * " << n << ".0\n";
+	}
+
+	return { "overloads", { { "main.aike", os.str() } } };
+}
+
+// Levels of structs where every struct contains two structs from the previous level
+Workload generateStructs(int scale)
+{
+	int levels = 8;
+	int width = 64 * scale;
+
+	ostringstream os;
+
+	for (int l = 0; l < levels; ++l)
+		for (int k = 0; k < width; ++k)
+		{
+			os << "struct L" << l << "_" << k << "\n";
+
+			if (l == 0)
+			{
+				os << "    x: int = " << k << "\n";
+				os << "    y: float = 1.0\n\n";
+
+				os << "fn get" << l << "_" << k << "(s: L" << l << "_" << k << "): int\n";
+				os << "    s.x\n\n";
+			}
+			else
+			{
+				string a = "L" + to_string(l - 1) + "_" + to_string(2 * k % width);
+				string b = "L" + to_string(l - 1) + "_" + to_string((2 * k + 1) % width);
+
+				os << "    a: " << a << " = " << a << " {}\n";
+				os << "    b: " << b << " = " << b << " {}\n";
+				os << "    x: int = " << k << "\n\n";
+
+				os << "fn get" << l << "_" << k << "(s: L" << l << "_" << k << "): int\n";
+				os << "    s.x + s.a.x + s.b.x\n\n";
+			}
+
+			os << "var s" << l << "_" << k << " = get" << l << "_" << k << "(L" << l << "_" << k << " {})\n\n";
+		}
+
+	return { "structs", { { "main.aike", os.str() } } };
+}
+
+// Many modules that form an import DAG
+Workload generateModules(int scale)
+{
+	int modules = 100 * scale;
+	int functions = 20;
+
+	Workload result = { "modules" };
+
+	for (int i = 0; i < modules; ++i)
+	{
+		ostringstream os;
+
+		vector<int> imports;
+
+		for (int j: { i - 1, i / 2, i / 3 })
+			if (j >= 0 && j < i && find(imports.begin(), imports.end(), j) == imports.end())
+				imports.push_back(j);
+
+		for (int j: imports)
+			os << "import m" << j << "\n";
+
+		os << "\n";
+
+		for (int n = 0; n < functions; ++n)
+		{
+			os << "fn m" << i << "f" << n << "(a: int): int\n";
+
+			if (imports.empty())
+				os << "    a + " << n << "\n\n";
+			else
+				os << "    m" << imports[n % imports.size()] << "f" << n << "(a) + " << n << "\n\n";
+		}
+
+		result.files.push_back(make_pair("m" + to_string(i) + ".aike", os.str()));
+	}
+
+	ostringstream os;
+
+	os << "import m" << (modules - 1) << "\n\n";
+	os << "print(m" << (modules - 1) << "f0(1))\n";
+
+	result.files.insert(result.files.begin(), make_pair("main.aike", os.str()));
+
+	return result;
+}
+
+string joinPath(const string& left, const string& right)
+{
+	string result = left;
+
+	if (!result.empty() && result.back() != '/')
+		result += '/';
+
+	result += right;
+
+	return result;
+}
+
+void createPathRec(const string& path)
+{
+	string copy = path;
+
+	for (size_t i = 1; i < copy.size(); ++i)
+		if (copy[i] == '/')
+		{
+			copy[i] = 0;
+
+			mkdir(copy.c_str(), 0755);
+
+			copy[i] = '/';
+		}
+
+	mkdir(copy.c_str(), 0755);
+}
+
+string getAbsolutePath(const string& path)
+{
+	char buf[PATH_MAX];
+
+	return realpath(path.c_str(), buf) ? buf : path;
+}
+
+// Writes the workload sources; the compiler runs in the workload folder, so the library is linked there as well
+bool writeWorkload(const Workload& workload, const string& path, unsigned int& lines)
+{
+	createPathRec(path);
+
+	lines = 0;
+
+	for (auto& f: workload.files)
+	{
+		FILE* file = fopen(joinPath(path, f.first).c_str(), "w");
+		if (!file) return false;
+
+		fwrite(f.second.data(), 1, f.second.size(), file);
+		fclose(file);
+
+		lines += count(f.second.begin(), f.second.end(), '\n');
+	}
+
+	string library = joinPath(path, "library");
+
+	unlink(library.c_str());
+
+	return symlink(getAbsolutePath("library").c_str(), library.c_str()) == 0;
+}
+
+// Parses --time output; returns pass times in milliseconds
+map<string, double> parseTimes(const string& output)
+{
+	map<string, double> result;
+
+	istringstream iss(output);
+
+	string line;
+	while (getline(iss, line))
+	{
+		char name[256];
+		unsigned int calls;
+		double time;
+
+		if (sscanf(line.c_str(), "%255s %u calls, %lf msec", name, &calls, &time) == 3)
+			result[name] = time;
+	}
+
+	return result;
+}
+
+typedef map<pair<string, string>, double> Baseline;
+
+bool readBaseline(Baseline& result, const string& path)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (!file) return false;
+
+	char line[1024];
+
+	while (fgets(line, sizeof(line), file))
+	{
+		char workload[256], pass[256];
+		double rate;
+
+		if (line[0] != '#' && sscanf(line, "%255s %255s %lf", workload, pass, &rate) == 3)
+			result[make_pair(workload, pass)] = rate;
+	}
+
+	fclose(file);
+
+	return true;
+}
+
+bool writeBaseline(const Baseline& baseline, const string& path)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	fprintf(file, "# workload pass lines/sec; regenerate with make bench-compiler BENCHFLAGS=--update\n");
+
+	for (auto& b: baseline)
+		fprintf(file, "%s %s %.0f\n", b.first.first.c_str(), b.first.second.c_str(), b.second);
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s [baseline.txt] [workload-path] [aikec-path] [--update] [-scale N] [-runs N] [-threshold P] [aikec-flags]\n", argv[0]);
+		return 1;
+	}
+
+	// get options
+	string baselinePath = argv[1];
+	string target = argv[2];
+	string compiler = getAbsolutePath(argv[3]);
+
+	bool update = false;
+	int scale = 1;
+	int runs = 3;
+	double threshold = 10;
+
+	vector<string> extraFlags;
+
+	for (int i = 4; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--update") == 0)
+			update = true;
+		else if (strcmp(argv[i], "-scale") == 0 && i + 1 < argc)
+			scale = max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc)
+			runs = max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc)
+			threshold = atof(argv[++i]);
+		else
+			extraFlags.push_back(argv[i]);
+	}
+
+	Baseline baseline;
+	bool hasBaseline = readBaseline(baseline, baselinePath);
+
+	// without a baseline there's nothing to detect regressions against
+	if (!hasBaseline && !update)
+	{
+		fprintf(stderr, "No baseline found at %s; run with --update to create it\n", baselinePath.c_str());
+		return 1;
+	}
+
+	Workload workloads[] =
+	{
+		generateFunctions(scale),
+		generateGenerics(scale),
+		generateOverloads(scale),
+		generateStructs(scale),
+		generateModules(scale),
+	};
+
+	Baseline current;
+	unsigned int regressions = 0;
+	bool failed = false;
+
+	for (auto& w: workloads)
+	{
+		string path = joinPath(target, w.name);
+		unsigned int lines = 0;
+
+		if (!writeWorkload(w, path, lines))
+		{
+			fprintf(stderr, "Benchmark %s failed: can't write sources to %s\n", w.name.c_str(), path.c_str());
+			failed = true;
+			continue;
+		}
+
+		// the cache would skip the work we're trying to measure
+		vector<string> flags = { "main.aike", "-o", "main", "--time", "--no-cache" };
+		flags.insert(flags.end(), extraFlags.begin(), extraFlags.end());
+
+		map<string, double> times;
+
+		for (int run = 0; run < runs; ++run)
+		{
+			string output, error;
+			int rc = system(compiler, flags, path, output, error);
+
+			if (rc != 0)
+			{
+				fprintf(stderr, "Benchmark %s failed: compilation failed with code %d\n", w.name.c_str(), rc);
+				fprintf(stderr, "Errors:\n%s", error.c_str());
+				failed = true;
+				break;
+			}
+
+			// the fastest run is the least affected by noise
+			for (auto& t: parseTimes(output))
+			{
+				auto it = times.find(t.first);
+
+				if (it == times.end() || t.second < it->second)
+					times[t.first] = t.second;
+			}
+		}
+
+		double total = 0;
+
+		for (auto& t: times)
+			total += t.second;
+
+		times["total"] = total;
+
+		printf("%s: %u lines\n", w.name.c_str(), lines);
+
+		for (auto& t: times)
+		{
+			if (t.second <= 0)
+				continue;
+
+			double rate = lines / (t.second / 1000);
+
+			current[make_pair(w.name, t.first)] = rate;
+
+			auto it = baseline.find(make_pair(w.name, t.first));
+
+			if (it == baseline.end())
+			{
+				printf("  %-20s %10.2f msec %12.0f lines/sec\n", t.first.c_str(), t.second, rate);
+				continue;
+			}
+
+			double change = (rate / it->second - 1) * 100;
+			bool regression = change < -threshold;
+
+			printf("  %-20s %10.2f msec %12.0f lines/sec %+7.1f%%%s\n", t.first.c_str(), t.second, rate, change, regression ? " REGRESSION" : "");
+
+			regressions += regression;
+		}
+	}
+
+	if (failed)
+		return 1;
+
+	if (update)
+	{
+		if (!writeBaseline(current, baselinePath))
+		{
+			fprintf(stderr, "Can't write baseline to %s\n", baselinePath.c_str());
+			return 1;
+		}
+
+		printf("Baseline updated: %s\n", baselinePath.c_str());
+		return 0;
+	}
+
+	if (regressions != 0)
+		printf("FAILURE: %u passes are more than %.0f%% slower than the baseline.\n", regressions, threshold);
+	else
+		printf("Success: no passes are more than %.0f%% slower than the baseline.\n", threshold);
+
+	return regressions != 0;
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "process.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+int system(const string& file, const vector<string>& args, const string& cwd, string& output, string& error)
+{
+	return system(file, args, cwd, string(), output, error);
+}
+
+int system(const string& file, const vector<string>& args, const string& cwd, const string& input, string& output, string& error)
+{
+	output.clear();
+	error.clear();
+
+	int pin[2], pout[2], perr[2];
+	if (pipe(pin) < 0 || pipe(pout) < 0 || pipe(perr) < 0)
+		return -1;
+
+	// processes forked by other threads must not inherit the input end, or the process never sees the end of the input
+	fcntl(pin[1], F_SETFD, FD_CLOEXEC);
+
+	pid_t pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (pid == 0)
+	{
+		// close other ends of the pipe
+		close(pin[1]);
+		close(pout[0]);
+		close(perr[0]);
+
+		// redirect stdin/stdout/stderr
+		dup2(pin[0], 0);
+		dup2(pout[1], 1);
+		dup2(perr[1], 2);
+
+		if (!cwd.empty() && chdir(cwd.c_str()) != 0)
+			_exit(1);
+
+		// call sh and exit if execvp fails
+		vector<char*> argv;
+
+		argv.push_back(const_cast<char*>(file.c_str()));
+
+		for (auto& a: args)
+			argv.push_back(const_cast<char*>(a.c_str()));
+
+		argv.push_back(nullptr);
+
+		_exit(execvp(file.c_str(), argv.data()));
+	}
+
+	// close process ends of the pipe
+	close(pin[0]);
+	close(pout[1]);
+	close(perr[1]);
+
+	// the process may exit before reading all input; the write fails instead of terminating the caller
+	signal(SIGPIPE, SIG_IGN);
+
+	size_t written = 0;
+
+	bool inOpen = true, outOpen = true, errOpen = true;
+
+	while (outOpen || errOpen)
+	{
+		if (inOpen && written == input.size())
+		{
+			close(pin[1]);
+			inOpen = false;
+		}
+
+		fd_set rset, wset;
+		FD_ZERO(&rset);
+		FD_ZERO(&wset);
+
+		if (inOpen) FD_SET(pin[1], &wset);
+		if (outOpen) FD_SET(pout[0], &rset);
+		if (errOpen) FD_SET(perr[0], &rset);
+
+		if (select(FD_SETSIZE, &rset, &wset, nullptr, nullptr) <= 0)
+			break;
+
+		char buf[4096];
+
+		if (inOpen && FD_ISSET(pin[1], &wset))
+		{
+			ssize_t size = write(pin[1], input.data() + written, input.size() - written);
+
+			if (size > 0)
+				written += size;
+			else
+				written = input.size();
+		}
+
+		if (outOpen && FD_ISSET(pout[0], &rset))
+		{
+			ssize_t size = read(pout[0], buf, sizeof(buf));
+
+			if (size > 0)
+				output.append(buf, size);
+			else
+				outOpen = false;
+		}
+
+		if (errOpen && FD_ISSET(perr[0], &rset))
+		{
+			ssize_t size = read(perr[0], buf, sizeof(buf));
+
+			if (size > 0)
+				error.append(buf, size);
+			else
+				errOpen = false;
+		}
+	}
+
+	// close our ends of the pipe
+	if (inOpen)
+		close(pin[1]);
+
+	close(pout[0]);
+	close(perr[0]);
+
+	// get process exit code
+	int status = -1;
+	waitpid(pid, &status, 0);
+
+	return status;
+}
\ No newline at end of file
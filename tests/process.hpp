@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs the executable with the arguments and captures its output; the working directory is kept if cwd is empty
+int system(const std::string& file, const std::vector<std::string>& args, const std::string& cwd, std::string& output, std::string& error);
+
+// Same as above, but also writes the input to the standard input of the process
+int system(const std::string& file, const std::vector<std::string>& args, const std::string& cwd, const std::string& input, std::string& output, std::string& error);
\ No newline at end of file
@@ -16,95 +16,18 @@
 #include <mutex>
 #include <thread>
 
-using namespace std;
-
-int system(const string& file, const vector<string>& args, string& output, string& error)
-{
-	output.clear();
-	error.clear();
-
-	int pout[2], perr[2];
-	if (pipe(pout) < 0 || pipe(perr) < 0)
-		return -1;
-
-	pid_t pid = fork();
-	if (pid < 0)
-		return -1;
-
-	if (pid == 0)
-	{
-		// close other ends of the pipe
-		close(pout[0]);
-		close(perr[0]);
-
-		// redirect stdout/stderr
-		dup2(pout[1], 1);
-		dup2(perr[1], 2);
-
-		// call sh and exit if execvp fails
-		vector<char*> argv;
-
-		argv.push_back(const_cast<char*>(file.c_str()));
-
-		for (auto& a: args)
-			argv.push_back(const_cast<char*>(a.c_str()));
-
-		argv.push_back(nullptr);
-
-		_exit(execvp(file.c_str(), argv.data()));
-	}
-
-	// close output ends of the pipe
-	close(pout[1]);
-	close(perr[1]);
-
-	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(pout[0], &set);
-	FD_SET(perr[0], &set);
-
-	while ((FD_ISSET(pout[0], &set) || FD_ISSET(perr[0], &set)) && select(FD_SETSIZE, &set, nullptr, nullptr, nullptr) > 0)
-	{
-		char buf[4096];
-
-		if (FD_ISSET(pout[0], &set))
-		{
-			ssize_t size = read(pout[0], buf, sizeof(buf));
-
-			if (size > 0)
-				output.append(buf, size);
-			else
-				FD_CLR(pout[0], &set);
-		}
-
-		if (FD_ISSET(perr[0], &set))
-		{
-			ssize_t size = read(perr[0], buf, sizeof(buf));
+#include "process.hpp"
 
-			if (size > 0)
-				error.append(buf, size);
-			else
-				FD_CLR(perr[0], &set);
-		}
-	}
-
-	// close input ends of the pipe
-	close(pout[0]);
-	close(perr[0]);
-
-	// get process exit code
-	int status = -1;
-	waitpid(pid, &status, 0);
-
-	return status;
-}
+using namespace std;
 
 enum class TestType
 {
 	Unknown,
 	Ok,
 	Error,
-	XFail
+	XFail,
+	Compile,
+	Repl
 };
 
 TestType parseTest(const char* path, string& output, vector<string>& extraFlags)
@@ -143,6 +66,16 @@ TestType parseTest(const char* path, string& output, vector<string>& extraFlags)
 				error |= (type != TestType::Unknown);
 				type = TestType::XFail;
 			}
+			else if (strcmp(line, "## COMPILE") == 0)
+			{
+				error |= (type != TestType::Unknown);
+				type = TestType::Compile;
+			}
+			else if (strcmp(line, "## REPL") == 0)
+			{
+				error |= (type != TestType::Unknown);
+				type = TestType::Repl;
+			}
 			else if (strncmp(line, "## FLAGS ", 9) == 0)
 			{
 				const char* start = line + 8;
@@ -180,6 +113,25 @@ TestType parseTest(const char* path, string& output, vector<string>& extraFlags)
 	return error ? TestType::Unknown : type;
 }
 
+string readFile(const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return string();
+
+	string result;
+
+	char buf[4096];
+	size_t size;
+
+	while ((size = fread(buf, 1, sizeof(buf), f)) > 0)
+		result.append(buf, size);
+
+	fclose(f);
+
+	return result;
+}
+
 string sanitizeErrors(const string& output, const string& source)
 {
 	istringstream iss(output);
@@ -230,7 +182,7 @@ TestResult runTest(const string& source, const string& target, const string& com
 	if (testType == TestType::Ok)
 	{
 		string output, error;
-		int rc = system(compiler, compileFlags, output, error);
+		int rc = system(compiler, compileFlags, string(), output, error);
 
 		if (rc != 0)
 		{
@@ -241,7 +193,7 @@ TestResult runTest(const string& source, const string& target, const string& com
 			return TestResult::Fail;
 		}
 
-		int re = system(target, {}, output, error);
+		int re = system(target, {}, string(), output, error);
 
 		if (re != 0)
 		{
@@ -267,7 +219,7 @@ TestResult runTest(const string& source, const string& target, const string& com
 	else if (testType == TestType::Error)
 	{
 		string output, error;
-		int rc = system(compiler, compileFlags, output, error);
+		int rc = system(compiler, compileFlags, string(), output, error);
 
 		if (rc == 0)
 		{
@@ -293,10 +245,78 @@ TestResult runTest(const string& source, const string& target, const string& com
 
 		return TestResult::Pass;
 	}
+	else if (testType == TestType::Compile)
+	{
+		string output, error;
+		int rc = system(compiler, compileFlags, string(), output, error);
+
+		if (rc != 0)
+		{
+			lock_guard<mutex> lock(outputMutex);
+
+			fprintf(stderr, "Test %s failed: compilation failed with code %d\n", source.c_str(), rc);
+			fprintf(stderr, "Errors:\n%s", error.c_str());
+			return TestResult::Fail;
+		}
+
+		// compiler reports about the test module are prefixed with the source path, like diagnostics
+		string report = sanitizeErrors(output, source);
+
+		if (report != expectedOutput)
+		{
+			lock_guard<mutex> lock(outputMutex);
+
+			fprintf(stderr, "Test %s failed: compiler output mismatch\n", source.c_str());
+			fprintf(stderr, "Expected output:\n%s", expectedOutput.c_str());
+			fprintf(stderr, "Actual output:\n%s", report.c_str());
+			return TestResult::Fail;
+		}
+
+		return TestResult::Pass;
+	}
+	else if (testType == TestType::Repl)
+	{
+		// the test file is the session input; the expected output is in comments that the REPL skips
+		vector<string> replFlags;
+
+		replFlags.push_back("--repl");
+
+		for (auto& f: extraFlags)
+			replFlags.push_back(f);
+
+		for (auto& f: testFlags)
+			replFlags.push_back(f);
+
+		string output, error;
+		int rc = system(compiler, replFlags, string(), readFile(source.c_str()), output, error);
+
+		if (rc != 0)
+		{
+			lock_guard<mutex> lock(outputMutex);
+
+			fprintf(stderr, "Test %s failed: session failed with code %d\n", source.c_str(), rc);
+			fprintf(stderr, "Errors:\n%s", error.c_str());
+			return TestResult::Fail;
+		}
+
+		if (output != expectedOutput || !error.empty())
+		{
+			lock_guard<mutex> lock(outputMutex);
+
+			fprintf(stderr, "Test %s failed: output mismatch\n", source.c_str());
+			fprintf(stderr, "Expected output:\n%s", expectedOutput.c_str());
+			fprintf(stderr, "Actual output:\n%s", output.c_str());
+			if (!error.empty())
+				fprintf(stderr, "Errors:\n%s", error.c_str());
+			return TestResult::Fail;
+		}
+
+		return TestResult::Pass;
+	}
 	else if (testType == TestType::XFail)
 	{
 		string output, error;
-		int rc = system(compiler, compileFlags, output, error);
+		int rc = system(compiler, compileFlags, string(), output, error);
 
 		if (rc == 0)
 		{